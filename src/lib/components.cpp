@@ -1,65 +1,239 @@
 #include "components.h"
+#include "physics.h"
 #include "scene.h"
+#include <deque>
 
 
-void engine::components::MovementSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
-    for (auto entity : q.Query<Movement>()) {
-        if (q.Has<SceneAssosication>(entity)) {
-            auto scene = q.Get<SceneAssosication>(entity).sceneName;
-            if (SceneManager::GetCurrentSceneName() != scene) {
-                continue;
+static bool InScene(engine::ecs::Querier &q, engine::ecs::Entity entity, engine::SceneID scene) {
+    using engine::components::SceneAssosication;
+    return q.Has<SceneAssosication>(entity) && q.Get<const SceneAssosication>(entity).scene == scene;
+}
+
+// Calls func(entity, comp) for the T entities of the current scene and for the ones without a scene.
+// Without a SceneIndex every T entity is visited and its scene id compared
+template<typename T, typename Func>
+static void EachInCurrentScene(engine::ecs::Querier &q, engine::ecs::Resources &r, Func &&func) {
+    using namespace engine;
+    using components::SceneAssosication;
+    auto currentScene = SceneManager::GetCurrentSceneID();
+    if (!r.Has<components::SceneIndex>()) {
+        q.Each<T>([&](ecs::Entity entity, T &comp) {
+            if (!q.Has<SceneAssosication>(entity) || q.Get<const SceneAssosication>(entity).scene == currentScene) {
+                func(entity, comp);
             }
+        });
+        return;
+    }
+
+    q.View<T>().template Without<SceneAssosication>().Each(func);
+    // The index may be a frame old when SceneIndexSystem runs late, entities destroyed, moved to another
+    // scene or left without one since (the view above has them) are skipped
+    for (auto entity : r.Get<components::SceneIndex>().Entities(currentScene)) {
+        if (InScene(q, entity, currentScene) && q.Has<T>(entity)) {
+            func(entity, q.Get<T>(entity));
+        }
+    }
+}
+
+// Gathers Movement rows into x and y arrays block by block for IntegrateMotion, which moves them
+// exactly like `pos += velocity * dt` would
+class MovementBatch final {
+public:
+    MovementBatch(float dt) : dt(dt) {}
+
+    void Add(engine::components::Movement &movement) {
+        movement.prevPos = movement.pos;
+        movement.interpolate = true;
+        this->x[this->count] = movement.pos.x;
+        this->y[this->count] = movement.pos.y;
+        this->velocityX[this->count] = movement.velocity.x;
+        this->velocityY[this->count] = movement.velocity.y;
+        this->targets[this->count++] = &movement;
+        if (this->count == block) {
+            this->Flush();
         }
+    }
+
+    void Flush() {
+        engine::IntegrateMotion(this->x, this->y, this->velocityX, this->velocityY, this->count, this->dt);
+        for (size_t i = 0; i < this->count; i++) {
+            this->targets[i]->pos = engine::Vec2(this->x[i], this->y[i]);
+        }
+        this->count = 0;
+    }
 
-        auto &movementComp = q.Get<Movement>(entity);
-        movementComp.pos += movementComp.velocity * Renderer::GetDeltatime();
+private:
+    static constexpr size_t block = 256;
+    alignas(32) float x[block];
+    alignas(32) float y[block];
+    alignas(32) float velocityX[block];
+    alignas(32) float velocityY[block];
+    engine::components::Movement *targets[block];
+    size_t count = 0;
+    float dt;
+};
+
+// Seconds covered by the current update, fixed when the world runs a fixed timestep
+static float UpdateDelta(engine::ecs::Resources &r) {
+    return r.Has<engine::ecs::Time>() ? r.Get<engine::ecs::Time>().delta : engine::Renderer::GetDeltatime();
+}
+
+// Where to draw a moving entity, between its last two simulated positions
+static engine::Vec2 RenderPosition(engine::ecs::Resources &r, const engine::components::Movement &movement) {
+    if (!movement.interpolate || !r.Has<engine::ecs::Time>()) {
+        return movement.pos;
     }
+    return engine::Vec2::Lerp(movement.prevPos, movement.pos, r.Get<engine::ecs::Time>().alpha);
 }
 
-void engine::components::Texture2DRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
-    for (auto entity : q.Query<Texture2D>()) {
-        if (q.Has<SceneAssosication>(entity)) {
-            auto scene = q.Get<SceneAssosication>(entity).sceneName;
-            if (SceneManager::GetCurrentSceneName() != scene) {
-                continue;
+// Tag names by id, a deque so that names handed out stay put while others are interned
+static std::map<std::string, uint32_t> collisionTagIDs = { { "", 0 } };
+static std::deque<std::string> collisionTagNames = { "" };
+static std::mutex collisionTagMutex;
+
+engine::components::CollisionTag::CollisionTag(const std::string &name) {
+    std::lock_guard lock(collisionTagMutex);
+    auto [it, inserted] = collisionTagIDs.emplace(name, (uint32_t) collisionTagNames.size());
+    if (inserted) {
+        collisionTagNames.push_back(name);
+    }
+    this->id = it->second;
+}
+
+const std::string &engine::components::CollisionTag::Name() const {
+    std::lock_guard lock(collisionTagMutex);
+    return collisionTagNames[this->id];
+}
+
+const std::vector<engine::ecs::Entity> &engine::components::SceneIndex::Entities(SceneID scene) const {
+    static const std::vector<ecs::Entity> none;
+    return scene < this->scenes.size() ? this->scenes[scene] : none;
+}
+
+void engine::components::AddSystemTimingHUD(ecs::World &world) {
+    auto &profiler = world.GetProfiler();
+    for (size_t slot = 0; slot < profiler.GetSlotCount(); slot++) {
+        auto name = profiler.GetStats(slot).name;
+        Renderer::DebugAddHUD(std::format("ecs.{}", name), [&profiler, slot]() {
+            auto stats = profiler.GetStats(slot);
+            return std::format("{:.3f}/{:.3f}/{:.3f} ms", stats.min, stats.avg, stats.p99);
+        });
+    }
+}
+
+void engine::components::PersistComponents(ecs::World &world) {
+    // Fields are registered once, a second registration would encode them twice
+    static std::once_flag reflected;
+    std::call_once(reflected, [] {
+        drefl::RegistReflection<BasicText>().Regist("BasicText")
+            .AddField("lines", &BasicText::lines)
+            .AddField("margin", &BasicText::margin)
+            .AddField("r", &BasicText::r)
+            .AddField("g", &BasicText::g)
+            .AddField("b", &BasicText::b)
+            .AddField("a", &BasicText::a)
+            .AddField("dpos", &BasicText::dpos);
+        drefl::RegistReflection<BasicGraph>().Regist("BasicGraph")
+            .AddField("drawCalls", &BasicGraph::drawCalls);
+        drefl::RegistReflection<LabelText>().Regist("LabelText")
+            .AddField("text", &LabelText::text)
+            .AddField("fontsize", &LabelText::fontsize)
+            .AddField("fg", &LabelText::fg)
+            .AddField("bg", &LabelText::bg)
+            .AddField("useColorKey", &LabelText::useColorKey)
+            .AddField("key", &LabelText::key)
+            .AddField("dPos", &LabelText::dPos)
+            .AddField("size", &LabelText::size);
+    });
+    world.Persist<Movement>("Movement");
+    world.Persist<Graph>("Graph");
+    world.Persist<SimpleSwitch>("SimpleSwitch");
+    world.Persist<BasicText>("BasicText");
+    world.Persist<BasicGraph>("BasicGraph");
+    world.Persist<LabelText>("LabelText");
+}
+
+void engine::components::InitResources(ecs::World &world) {
+    world.InitResource<SceneIndex>();
+    world.InitResource<BasicTextCache>();
+    world.InitResource<CollisionBroadPhase>();
+    world.InitResource<ColliderTree>();
+}
+
+void engine::components::SceneIndexSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
+    auto &index = r.Get<SceneIndex>();
+    auto group = q.Group<const SceneAssosication>();
+
+    // Rebuilt only when a scene component has been added or changed, or removed (the count drops)
+    bool changed = group.Size() != index.count;
+    if (!changed) {
+        q.View<const SceneAssosication>().Changed<SceneAssosication>().Each([&](const SceneAssosication &) {
+            changed = true;
+        });
+    }
+    if (!changed) {
+        return;
+    }
+
+    for (auto &entities : index.scenes) {
+        entities.clear();
+    }
+    group.Each([&](ecs::Entity entity, const SceneAssosication &association) {
+        if (association.scene >= index.scenes.size()) {
+            index.scenes.resize(association.scene + 1);
+        }
+        index.scenes[association.scene].push_back(entity);
+    });
+    index.count = group.Size();
+}
+
+void engine::components::MovementSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
+    auto currentScene = SceneManager::GetCurrentSceneID();
+    auto indexed = r.Has<SceneIndex>();
+    MovementBatch batch(UpdateDelta(r));
+    q.ForEachChunk<Movement>([&](ecs::ChunkView chunk) {
+        auto scenes = chunk.Column<const SceneAssosication>();
+        // Scene-bound entities come from the index when there is one, rigid bodies belong to PhysicsSystem
+        if ((scenes && indexed) || chunk.Column<const physics::RigidBody>()) {
+            return;
+        }
+        auto movements = chunk.Column<Movement>();
+        for (size_t i = 0; i < chunk.Size(); i++) {
+            if (!scenes || scenes[i].scene == currentScene) {
+                batch.Add(movements[i]);
             }
         }
+    });
+    if (indexed) {
+        for (auto entity : r.Get<SceneIndex>().Entities(currentScene)) {
+            if (InScene(q, entity, currentScene) && q.Has<Movement>(entity) && !q.Has<physics::RigidBody>(entity)) {
+                batch.Add(q.Get<Movement>(entity));
+            }
+        }
+    }
+    batch.Flush();
+}
 
-        auto comp = q.Get<Texture2D>(entity);
+void engine::components::Texture2DRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
+    EachInCurrentScene<const Texture2D>(q, r, [&](ecs::Entity entity, const Texture2D &comp) {
         if (!q.Has<Movement>(entity)) {
             Renderer::RenderTexture(comp.t, comp.renderPos);
         } else {
-            Renderer::RenderTexture(comp.t, q.Get<Movement>(entity).pos);
+            Renderer::RenderTexture(comp.t, RenderPosition(r, q.Get<const Movement>(entity)));
         }
-    }
+    });
 }
 
 void engine::components::BasicGraphRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
-    for (auto entity : q.Query<BasicGraph>()) {
-        if (q.Has<SceneAssosication>(entity)) {
-            auto scene = q.Get<SceneAssosication>(entity).sceneName;
-            if (SceneManager::GetCurrentSceneName() != scene) {
-                continue;
-            }
-        }
-
-        auto comp = q.Get<BasicGraph>(entity);
+    EachInCurrentScene<const BasicGraph>(q, r, [&](ecs::Entity entity, const BasicGraph &comp) {
         for (auto drawCall : comp.drawCalls) {
             // Not implemented yet
         }
-    }
+    });
 }
 
 void engine::components::GraphRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
-    for (auto entity : q.Query<Graph>()) {
-        if (q.Has<SceneAssosication>(entity)) {
-            auto scene = q.Get<SceneAssosication>(entity).sceneName;
-            if (SceneManager::GetCurrentSceneName() != scene) {
-                continue;
-            }
-        }
-
-        auto comp = q.Get<Graph>(entity);
+    EachInCurrentScene<const Graph>(q, r, [&](ecs::Entity entity, const Graph &comp) {
         if (comp.visible) {
             switch (comp.graphType) {
             case 1: {
@@ -68,7 +242,7 @@ void engine::components::GraphRenderSystem(ecs::Commands &commander, ecs::Querie
                 }
                 auto pos = comp.p1;
                 if (q.Has<Movement>(entity)) {
-                    pos = q.Get<Movement>(entity).pos;
+                    pos = RenderPosition(r, q.Get<const Movement>(entity));
                 }
                 Renderer::FillRect(pos, comp.p2);
                 Renderer::ClearDrawColor();
@@ -80,7 +254,7 @@ void engine::components::GraphRenderSystem(ecs::Commands &commander, ecs::Querie
                 }
                 auto pos = comp.p1;
                 if (q.Has<Movement>(entity)) {
-                    pos = q.Get<Movement>(entity).pos;
+                    pos = RenderPosition(r, q.Get<const Movement>(entity));
                 }
                 Renderer::DrawRect(pos, comp.p2);
                 Renderer::ClearDrawColor();
@@ -90,44 +264,87 @@ void engine::components::GraphRenderSystem(ecs::Commands &commander, ecs::Querie
                 break;
             }
         }
+    });
+}
+
+engine::components::BasicTextCache::BasicTextCache(BasicTextCache &&other) noexcept : texts(std::move(other.texts)) {
+    other.texts.clear();
+}
+
+engine::components::BasicTextCache &engine::components::BasicTextCache::operator=(BasicTextCache &&other) noexcept {
+    if (this != &other) {
+        this->Clear();
+        this->texts = std::move(other.texts);
+        other.texts.clear();
+    }
+    return *this;
+}
+
+engine::components::BasicTextCache::~BasicTextCache() {
+    this->Clear();
+}
+
+void engine::components::BasicTextCache::Release(Text &text) {
+    for (auto &line : text.lines) {
+        SDL_DestroyTexture(line.texture.textureData);
+    }
+    text.lines.clear();
+}
+
+void engine::components::BasicTextCache::Clear() {
+    for (auto &[entity, text] : this->texts) {
+        Release(text);
     }
+    this->texts.clear();
 }
 
 void engine::components::BasicTextRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
+    // Rendered lines are kept per entity and only re-rendered when the text component changes
+    auto &cache = r.Get<BasicTextCache>().texts;
+
     auto font = Renderer::GetGlobalFont();
-    for (auto entity : q.Query<BasicText>()) {
-        if (q.Has<SceneAssosication>(entity)) {
-            auto scene = q.Get<SceneAssosication>(entity).sceneName;
-            if (SceneManager::GetCurrentSceneName() != scene) {
-                continue;
+    auto build = [&](BasicTextCache::Text &cached, const BasicText &comp) {
+        BasicTextCache::Release(cached);
+        cached.font = font;
+        for (const auto &text : comp.lines) {
+            int _, h;
+            TTF_SizeUTF8(font, text.c_str(), &_, &h);
+            cached.lines.push_back(BasicTextCache::Line { Renderer::Text(text, SDL_Color { comp.r, comp.g, comp.b, comp.a }), h });
+        }
+    };
+
+    q.View<const BasicText>().Changed<BasicText>().Each([&](ecs::Entity entity, const BasicText &comp) {
+        build(cache[entity], comp);
+    });
+    // Every live text has an entry by now, so extra entries belong to destroyed entities or removed texts,
+    // which give their textures back
+    if (cache.size() > q.Group<const BasicText>().Size()) {
+        for (auto it = cache.begin(); it != cache.end();) {
+            if (!q.Has<BasicText>(it->first)) {
+                BasicTextCache::Release(it->second);
+                it = cache.erase(it);
+            } else {
+                it++;
             }
         }
+    }
 
-        auto comp = q.Get<BasicText>(entity);
+    EachInCurrentScene<const BasicText>(q, r, [&](ecs::Entity entity, const BasicText &comp) {
+        auto &cached = cache[entity];
+        if (cached.font != font) {
+            build(cached, comp);
+        }
         Renderer::SetDrawColor(comp.r, comp.g, comp.b, comp.a);
         auto pos = comp.dpos;
         if (q.Has<Movement>(entity)) {
-            pos = q.Get<Movement>(entity).pos;
+            pos = RenderPosition(r, q.Get<const Movement>(entity));
         }
-        std::vector<Renderer::Texture> cache;
-        for (const auto &text : comp.lines) {
-            cache.push_back(Renderer::Text(text));
-        }
-
-        int index = 0;
-        for (auto && c : cache) {
-            int _, h;
-            TTF_SizeUTF8(font, comp.lines[index].c_str(), &_, &h);
-            Renderer::RenderTexture(c, pos);
-            pos.y += h + comp.margin;
-            index++;
-        }
-        
-        for (auto &v : cache) {
-            SDL_DestroyTexture(v.textureData);
+        for (auto &line : cached.lines) {
+            Renderer::RenderTexture(line.texture, pos);
+            pos.y += line.height + comp.margin;
         }
         Renderer::ClearDrawColor();
-    }
+    });
 }
 
 void engine::components::SimpleSwitchSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
@@ -137,76 +354,133 @@ void engine::components::SimpleSwitchSystem(ecs::Commands &commander, ecs::Queri
 }
 
 void engine::components::SimpleCollider2DSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
-    std::vector<QuadTree::ObjectWithRect> collidingEntities;
-    std::vector<QuadTree::ObjectWithRect> filtedEntities;
-    //QuadTree qt(0, Vec2(0, 0), Vec2(WINDOW_WIDTH, WINDOW_HEIGHT));
+    auto &broadPhase = r.Get<CollisionBroadPhase>();
+    broadPhase.grid.Clear();
+    broadPhase.entities.clear();
+    broadPhase.tags.clear();
 
     // Filter some entities that must not be colliding
-    for (auto entity : q.Query<SimpleCollider2D>()) {
-        if (q.Has<SceneAssosication>(entity)) {
-            auto scene = q.Get<SceneAssosication>(entity).sceneName;
-            if (SceneManager::GetCurrentSceneName() != scene) {
-                continue;
-            }
-        }
-
+    size_t handlers = 0;
+    EachInCurrentScene<const SimpleCollider2D>(q, r, [&](ecs::Entity entity, const SimpleCollider2D &comp) {
         Vec2 pos;
         if (q.Has<Movement>(entity)) {
-            pos = q.Get<Movement>(entity).pos;
+            pos = q.Get<const Movement>(entity).pos;
         } else {
-            continue;
+            return;
         }
-        
-        auto comp = q.Get<SimpleCollider2D>(entity);
 
         if (comp.showCollider) {
             Renderer::SetDrawColor(0, 255, 255, 255);
             Renderer::DrawRect(pos, comp.size);
             Renderer::ClearDrawColor();
         }
-        // collidingEntities.push_back(QuadTree::ObjectWithRect { comp.tag, reinterpret_cast<void *>(entity), pos, comp.size });
+        broadPhase.grid.Insert(pos, comp.size);
+        broadPhase.entities.push_back(entity);
+        broadPhase.tags.push_back(comp.tag);
+        handlers += (bool) comp.onCollide;
+    });
+
+    broadPhase.grid.Pairs(broadPhase.pairs);
+    std::swap(broadPhase.contacts, broadPhase.previous);
+    auto &contacts = broadPhase.contacts;
+    contacts.clear();
+    for (auto [i, j] : broadPhase.pairs) {
+        if (broadPhase.entities[j] < broadPhase.entities[i]) {
+            std::swap(i, j);
+        }
+        contacts.push_back(CollisionEvent {
+            broadPhase.entities[i], broadPhase.entities[j], broadPhase.tags[i], broadPhase.tags[j], CollisionPhase::Begin
+        });
     }
+    auto byPair = [](const CollisionEvent &x, const CollisionEvent &y) {
+        return x.a != y.a ? x.a < y.a : x.b < y.b;
+    };
+    std::sort(contacts.begin(), contacts.end(), byPair);
 
-    // for (auto e : collidingEntities) {
-    //     qt.Retrieve(filtedEntities, e.pos, e.size);
-    // }
-
-    // Check for collisions
-    #ifdef __linux__
-        using NType = long;
-    #else
-        using NType = long long;
-    #endif
-
-    for (auto entity : collidingEntities) {
-        auto r1 = Vec2::CreateFRect(entity.pos, entity.size);
-        for (auto item : collidingEntities) {
-            if (item.object == entity.object) {
-                continue;
-            }
-            auto id = (ecs::Entity) ((NType) entity.object);
-            auto collideId = (ecs::Entity) ((NType) item.object);
-
-            auto CollisionHandler = q.Get<SimpleCollider2D>(id).onCollide;
-            
-            auto r2 = Vec2::CreateFRect(item.pos, item.size);
-            auto r3 = Vec2::CreateFRect(Vec2(), Vec2());
-            if (SDL_IntersectFRect(&r1, &r2, &r3)) {
-                CollisionHandler(entity.id, id, item.id, collideId);
-            }
+    // Both lists are sorted, a merge tells the pairs that went on touching from the ones that began or ended
+    auto &previous = broadPhase.previous;
+    auto &events = broadPhase.events;
+    events.clear();
+    size_t p = 0;
+    for (auto &contact : contacts) {
+        while (p < previous.size() && byPair(previous[p], contact)) {
+            events.push_back(previous[p++]);
+            events.back().phase = CollisionPhase::End;
+        }
+        if (p < previous.size() && !byPair(contact, previous[p])) {
+            contact.phase = CollisionPhase::Stay;
+            p++;
+        }
+        events.push_back(contact);
+    }
+    for (; p < previous.size(); p++) {
+        events.push_back(previous[p]);
+        events.back().phase = CollisionPhase::End;
+    }
+    e.Writer<CollisionEvent>().Write(std::span<const CollisionEvent>(events));
+
+    // Colliders still carrying a handler hear about their pairs right away
+    for (size_t i = 0; i < contacts.size() && handlers != 0; i++) {
+        auto contact = contacts[i];
+        auto &a = q.Get<const SimpleCollider2D>(contact.a);
+        if (a.onCollide) {
+            a.onCollide(contact.tagA.Name(), contact.a, contact.tagB.Name(), contact.b);
+        }
+        auto &b = q.Get<const SimpleCollider2D>(contact.b);
+        if (b.onCollide) {
+            b.onCollide(contact.tagB.Name(), contact.b, contact.tagA.Name(), contact.a);
         }
     }
 }
 
-void engine::components::SimpleTimerSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
-    for (auto entity : q.Query<SimpleTimer>()) {
-        if (q.Has<SceneAssosication>(entity)) {
-            if (q.Get<SceneAssosication>(entity).sceneName != SceneManager::GetCurrentSceneName()) {
-                continue;
+void engine::components::ColliderTreeSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
+    auto &index = r.Get<ColliderTree>();
+    auto &tree = index.tree;
+    index.frame++;
+
+    // Moves within the fattened boxes leave the tree untouched
+    size_t tracked = tree.Size(), visited = 0;
+    EachInCurrentScene<const SimpleCollider2D>(q, r, [&](ecs::Entity entity, const SimpleCollider2D &comp) {
+        if (!q.Has<Movement>(entity)) {
+            return;
+        }
+        auto &pos = q.Get<const Movement>(entity).pos;
+        auto slot = ecs::EntityTraits::ToIndex(entity);
+        if (slot >= index.proxies.size()) {
+            index.proxies.resize(slot + 1);
+        }
+        auto &proxy = index.proxies[slot];
+        if (proxy.entity == entity) {
+            tree.Move(proxy.proxy, pos, comp.size);
+        } else {
+            // The slot may still hold the proxy of a destroyed entity
+            if (proxy.proxy != AABBTree::null) {
+                tree.Remove(proxy.proxy);
+                tracked--;
             }
+            proxy.entity = entity;
+            proxy.proxy = tree.Insert(pos, comp.size, entity);
+            tracked++;
         }
-        auto dt = Renderer::GetDeltatime();
-        auto &timer = q.Get<SimpleTimer>(entity);
+        proxy.seen = index.frame;
+        visited++;
+    });
+
+    // Every proxy left unvisited belongs to an entity that is gone or out of the scene
+    if (tracked == visited) {
+        return;
+    }
+    for (auto &proxy : index.proxies) {
+        if (proxy.proxy != AABBTree::null && proxy.seen != index.frame) {
+            tree.Remove(proxy.proxy);
+            proxy = ColliderTree::Proxy {};
+        }
+    }
+}
+
+void engine::components::SimpleTimerSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
+    auto dt = UpdateDelta(r);
+    EachInCurrentScene<SimpleTimer>(q, r, [&](ecs::Entity entity, SimpleTimer &timer) {
         if (timer.isActivated && timer.shots < timer.maxShots) {
             timer.current += dt;
             if ((int) (timer.current * 1000) > timer.duration) {
@@ -215,7 +489,7 @@ void engine::components::SimpleTimerSystem(ecs::Commands &commander, ecs::Querie
                 timer.shots++;
             }
         }
-    }
+    });
 }
 
 [[deprecated]] void engine::components::LabelTextRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
@@ -223,7 +497,7 @@ void engine::components::SimpleTimerSystem(ecs::Commands &commander, ecs::Querie
 
     for (auto entity : q.Query<LabelText>()) {
         if (q.Has<SceneAssosication>(entity)) {
-            if (q.Get<SceneAssosication>(entity).sceneName != SceneManager::GetCurrentSceneName()) {
+            if (q.Get<const SceneAssosication>(entity).scene != SceneManager::GetCurrentSceneID()) {
                 continue;
             }
         }
@@ -1,13 +1,21 @@
 #pragma once
 #include "ecs.h"
 #include "render.h"
+#include "scene.h"
 
 
 namespace engine {
+    namespace physics {
+        struct RigidBody;
+    }
+
     namespace components {
         struct Movement {
             Vec2 velocity;
             Vec2 pos;
+            // Position before the last update, set by MovementSystem for render interpolation
+            Vec2 prevPos;
+            bool interpolate = false;
         };
 
         struct Texture2D {
@@ -41,20 +49,101 @@ namespace engine {
             Vec2 dpos;
         };
 
+        // Lines rendered by BasicTextRenderSystem, kept per entity until the text changes. The textures
+        // are freed with the resource, so the world has to shut down before the renderer does
+        struct BasicTextCache {
+            struct Line {
+                Renderer::Texture texture;
+                int height;
+            };
+            struct Text {
+                TTF_Font *font = nullptr;
+                std::vector<Line> lines;
+            };
+
+            std::unordered_map<ecs::Entity, Text> texts;
+
+            BasicTextCache() = default;
+            BasicTextCache(const BasicTextCache &) = delete;
+            BasicTextCache &operator=(const BasicTextCache &) = delete;
+            BasicTextCache(BasicTextCache &&other) noexcept;
+            BasicTextCache &operator=(BasicTextCache &&other) noexcept;
+            ~BasicTextCache();
+
+            static void Release(Text &text);
+            void Clear();
+        };
+
         struct SimpleSwitch {
             bool status;
             int type;
             Uint8 val;
         };
 
+        // Collider tags are compared by interned id, the name is only looked up for display
+        struct CollisionTag {
+            uint32_t id = 0;
+
+            CollisionTag() = default;
+            CollisionTag(const std::string &name);
+            CollisionTag(const char *name) : CollisionTag(std::string(name)) {}
+
+            const std::string &Name() const;
+            bool operator==(const CollisionTag &other) const = default;
+        };
+
         struct SimpleCollider2D {
-            std::string tag;
+            CollisionTag tag;
             bool showCollider = false;
             // Vec2 pos;
             Vec2 size;
+            // Deprecated, read CollisionEvent instead. Still called by SimpleCollider2DSystem during the frame
+            // for every pair that touches, from both sides, while events only become readable the frame after
             std::function<void(const std::string &, ecs::Entity, const std::string &, ecs::Entity)> onCollide;
         };
 
+        enum class CollisionPhase : uint8_t {
+            Begin, Stay, End
+        };
+
+        // Written by SimpleCollider2DSystem for every overlapping pair, `a` being the smaller handle.
+        // Readable from the next frame on through Events::Reader<CollisionEvent>()
+        struct CollisionEvent {
+            ecs::Entity a;
+            ecs::Entity b;
+            CollisionTag tagA;
+            CollisionTag tagB;
+            CollisionPhase phase;
+        };
+
+        // Kept by SimpleCollider2DSystem across frames. `contacts` holds this frame's overlapping pairs
+        // sorted by (a, b), without the ended ones. Colliders much larger than the cells make the grid
+        // slower, not wrong
+        struct CollisionBroadPhase {
+            SpatialHash grid;
+            std::vector<ecs::Entity> entities;
+            std::vector<CollisionTag> tags;
+            std::vector<std::pair<uint32_t, uint32_t>> pairs;
+            std::vector<CollisionEvent> contacts;
+            std::vector<CollisionEvent> previous;
+            std::vector<CollisionEvent> events;
+        };
+
+        // Colliders of the current scene that have a Movement, kept in a dynamic AABB tree by
+        // ColliderTreeSystem for point, box, radius and ray queries. Query data is the entity
+        struct ColliderTree {
+            struct Proxy {
+                ecs::Entity entity = ecs::EntityTraits::null;
+                int32_t proxy = AABBTree::null;
+                uint32_t seen = 0;
+            };
+
+            AABBTree tree;
+            // Indexed by entity index
+            std::vector<Proxy> proxies;
+            uint32_t frame = 0;
+        };
+
         struct SimpleTimer {
             int shots = 0;
             int maxShots;
@@ -76,8 +165,21 @@ namespace engine {
             }
         };
 
+        // Systems only compare the interned id, never the name
         struct SceneAssosication {
-            std::string sceneName;
+            SceneID scene;
+
+            SceneAssosication(SceneID scene) : scene(scene) {}
+            SceneAssosication(const std::string &sceneName) : scene(SceneManager::GetSceneID(sceneName)) {}
+        };
+
+        // Entities of every scene, indexed by scene id. Kept by SceneIndexSystem, so the built-in
+        // systems registered after it visit the entities of the current scene only
+        struct SceneIndex {
+            std::vector<std::vector<ecs::Entity>> scenes;
+            size_t count = 0;
+
+            const std::vector<ecs::Entity> &Entities(SceneID scene) const;
         };
 
         struct IndivisualTimer {};
@@ -93,6 +195,16 @@ namespace engine {
             Vec2 size;
         };
 
+        // Persists the built-in components for World::Save, the ones that are not trivially copyable through
+        // their drefl reflection. Scene and collision tag ids are interned per run, so the components holding
+        // them are left out
+        void PersistComponents(ecs::World &world);
+
+        // Sets up the resources SceneIndexSystem, BasicTextRenderSystem, SimpleCollider2DSystem and
+        // ColliderTreeSystem keep, call it when registering them and again after World::Shutdown
+        void InitResources(ecs::World &world);
+
+        void SceneIndexSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
         void MovementSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
         void Texture2DRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
         void BasicGraphRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
@@ -100,7 +212,18 @@ namespace engine {
         void BasicTextRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
         void SimpleSwitchSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
         void SimpleCollider2DSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
+        void ColliderTreeSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
         void SimpleTimerSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
         void LabelTextRenderSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
+
+        // Shows min/avg/p99 of every system profiled by the world on the debug HUD,
+        // call it once the systems are registered
+        void AddSystemTimingHUD(ecs::World &world);
+
+        // Access set for registering MovementSystem with World::AddSystem(system, access),
+        // the other built-in systems render or run user callbacks and stay exclusive
+        inline ecs::SystemAccess MovementSystemAccess() {
+            return ecs::SystemAccess().Write<Movement>().Read<SceneAssosication, physics::RigidBody>().ReadResource<SceneIndex, ecs::Time>();
+        }
     }
 }
\ No newline at end of file
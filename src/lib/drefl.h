@@ -2,6 +2,13 @@
 
 #include "refl_common.h"
 #include <list>
+#include <string>
+#include <vector>
+#include <span>
+#include <format>
+#include <cassert>
+#include <cstring>
+#include <cstdint>
 
 
 namespace engine::drefl {
@@ -11,7 +18,7 @@ namespace engine::drefl {
         class Bool;
 
         class Type;
-        std::list<const Type *> _typelist;
+        inline std::list<const Type *> _typelist;
 
     class any {
         public:
@@ -312,8 +319,23 @@ namespace engine::drefl {
             // If target is a field, args = { ptr to this }
             // Else if target is a method, args = { ptr to this, args... }
             virtual any Call(const std::vector<any> &args) = 0;
+
+            // Fields write and read their value in the object in place, methods have nothing to encode
+            virtual void Encode(const void *object, std::vector<std::byte> &out) const {}
+            virtual bool Decode(void *object, std::span<const std::byte> in, size_t &cursor) const {
+                return true;
+            }
         };
 
+        // Binary codec generated from the registered fields. Trivially copyable values are copied bytewise,
+        // strings and vectors are prefixed with their length and classes write their fields in registration
+        // order. Decode fills a default-constructed value and returns false on truncated input
+        template<typename T>
+        void Encode(const T &value, std::vector<std::byte> &out);
+
+        template<typename T>
+        bool Decode(T &value, std::span<const std::byte> in, size_t &cursor);
+
     template<typename T>
       any MakeCopy(const T &);
 
@@ -349,6 +371,14 @@ namespace engine::drefl {
                 auto v = inst->*ptr;
                 return MakeCopy(v);
             }
+
+            void Encode(const void *object, std::vector<std::byte> &out) const override {
+                drefl::Encode(((const Clazz *) object)->*ptr, out);
+            }
+
+            bool Decode(void *object, std::span<const std::byte> in, size_t &cursor) const override {
+                return drefl::Decode(((Clazz *) object)->*ptr, in, cursor);
+            }
         };
 
     template<typename T, bool IsConst = false>
@@ -639,6 +669,84 @@ namespace engine::drefl {
         }
 
 
+        namespace details {
+            template<typename T>
+            struct is_vector : std::false_type {};
+
+            template<typename T, typename Alloc>
+            struct is_vector<std::vector<T, Alloc>> : std::true_type {};
+        }
+
+        template<typename T>
+        void Encode(const T &value, std::vector<std::byte> &out) {
+            if constexpr (std::is_trivially_copyable_v<T>) {
+                auto at = out.size();
+                out.resize(at + sizeof(T));
+                std::memcpy(out.data() + at, &value, sizeof(T));
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                Encode((uint64_t) value.size(), out);
+                auto at = out.size();
+                out.resize(at + value.size());
+                std::memcpy(out.data() + at, value.data(), value.size());
+            } else if constexpr (details::is_vector<T>::value) {
+                Encode((uint64_t) value.size(), out);
+                for (const auto &item : value) {
+                    Encode<typename T::value_type>(item, out);
+                }
+            } else {
+                static_assert(std::is_class_v<T>, "Type cannot be encoded");
+                auto &fields = GetType<T>()->AsClass()->GetFields();
+                assert(!fields.empty() && "Register the fields of the class with RegistReflection first");
+                for (auto field : fields) {
+                    field->Encode(&value, out);
+                }
+            }
+        }
+
+        template<typename T>
+        bool Decode(T &value, std::span<const std::byte> in, size_t &cursor) {
+            if constexpr (std::is_trivially_copyable_v<T>) {
+                if (in.size() - std::min(cursor, in.size()) < sizeof(T)) {
+                    return false;
+                }
+                std::memcpy(&value, in.data() + cursor, sizeof(T));
+                cursor += sizeof(T);
+                return true;
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                uint64_t size;
+                if (!Decode(size, in, cursor) || size > in.size() - cursor) {
+                    return false;
+                }
+                value.assign((const char *) in.data() + cursor, size);
+                cursor += size;
+                return true;
+            } else if constexpr (details::is_vector<T>::value) {
+                // Every item takes a byte at least, which bounds the count of a corrupt input
+                uint64_t size;
+                if (!Decode(size, in, cursor) || size > in.size() - cursor) {
+                    return false;
+                }
+                value.clear();
+                value.reserve(size);
+                for (uint64_t i = 0; i < size; i++) {
+                    typename T::value_type item {};
+                    if (!Decode(item, in, cursor)) {
+                        return false;
+                    }
+                    value.push_back(std::move(item));
+                }
+                return true;
+            } else {
+                static_assert(std::is_class_v<T>, "Type cannot be decoded");
+                for (auto field : GetType<T>()->AsClass()->GetFields()) {
+                    if (!field->Decode(&value, in, cursor)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+        }
+
     template<typename T>
     struct operation_traits {
         static any Copy(const any &a) {
@@ -1,5 +1,7 @@
 #pragma once
 #include "utils.hpp"
+#include "jobs.hpp"
+#include "drefl.h"
 #include <vector>
 #include <optional>
 #include <cassert>
@@ -8,11 +10,30 @@
 #include <limits>
 #include <algorithm>
 #include <unordered_map>
+#include <bitset>
+#include <new>
 #include <functional>
+#include <span>
+#include <cmath>
+#include <chrono>
+#include <numeric>
+#include <fstream>
+#include <string>
+#include <iterator>
 #include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <cstring>
 
 #define assertm(cond, msgf) assert((cond) && msgf)
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifndef __linux__
 #endif
 
@@ -21,111 +42,201 @@ namespace engine {
         using ComponentID = uint32_t;
         using Entity = uint32_t;
 
+        // An entity handle packs its slot index (low bits) and the slot's generation (high bits).
+        // Destroyed slots are recycled with the next generation, so stale handles can be told apart
+        struct EntityTraits final {
+            static constexpr uint32_t INDEX_BITS = 20;
+            static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+            static constexpr uint32_t VERSION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+            // The all-ones index is never handed out, so no live handle equals null
+            static constexpr Entity null = std::numeric_limits<Entity>::max();
+
+            static constexpr uint32_t ToIndex(Entity entity) {
+                return entity & INDEX_MASK;
+            }
+
+            static constexpr uint32_t ToVersion(Entity entity) {
+                return entity >> INDEX_BITS;
+            }
+
+            static constexpr Entity Combine(uint32_t index, uint32_t version) {
+                return ((version & VERSION_MASK) << INDEX_BITS) | (index & INDEX_MASK);
+            }
+        };
+
         struct Component {};
         struct Resource {};
 
+        // Component ids are handed out densely, so they double as bit positions in a signature
+        inline constexpr size_t MAX_COMPONENT_TYPES = 128;
+        using Signature = std::bitset<MAX_COMPONENT_TYPES>;
+
+        // Change ticks come from a world-wide counter bumped for every system run and every command
+        // playback. The counter wraps around, so ticks are only compared relative to the current one:
+        // a tick is newer than `lastRun` if it lies in (lastRun, thisRun]
+        inline bool IsNewerTick(uint32_t tick, uint32_t lastRun, uint32_t thisRun) {
+            return thisRun - tick < thisRun - lastRun;
+        }
+
+        template<typename Category>
+        class IndexGetter final {
+        public:
+            template<typename T>
+            static uint32_t Get() {
+                static uint32_t id = currentIndex++;
+                return id;
+            }
+        private:
+            inline static std::atomic<uint32_t> currentIndex = 0;
+        };
+
+        template<typename T, typename = std::enable_if<std::is_integral_v<T>>>
+        struct IDGenerator final {
+            static T Generate() {
+                return currentId++;
+            }
+        private:
+            inline static std::atomic<T> currentId = {};
+        };
+
+        struct Event {};
+
+        class EventChannelBase {
+        public:
+            virtual ~EventChannelBase() = default;
+            virtual void Swap() = 0;
+        };
+
+        // Double-buffered queue of one event type. Events written during a frame go to the back
+        // buffer and become readable once the frame ends, when the previous front buffer is recycled.
+        // Every event gets a sequence number, which is what reader cursors point at
         template<typename T>
-        class EventStaging final {
+        class EventChannel final : public EventChannelBase {
         public:
-            static bool Has() {
-                return data.has_value();
+            template<typename ...Args>
+            void Emplace(Args &&...args) {
+                std::lock_guard lock(this->mutex);
+                this->back.emplace_back(std::forward<Args>(args)...);
+            }
+
+            void Append(std::span<const T> events) {
+                std::lock_guard lock(this->mutex);
+                this->back.insert(this->back.end(), events.begin(), events.end());
             }
 
-            static void Set(const T &t) {
-                data = t;
+            // Events readable this frame, starting at sequence number `from`
+            std::span<const T> Pending(uint64_t from) const {
+                auto begin = std::min<uint64_t>(std::max(from, this->frontStart) - this->frontStart, this->front.size());
+                return std::span<const T>(this->front.data() + begin, this->front.size() - begin);
             }
 
-            static T &Get() {
-                return data.value();
+            uint64_t End() const {
+                return this->frontStart + this->front.size();
             }
 
-            static void Clear() {
-                data = std::nullopt;
+            void Swap() override {
+                this->frontStart += this->front.size();
+                this->front.clear();
+                std::swap(this->front, this->back);
             }
+
         private:
-            inline static std::optional<T> data = std::nullopt;
+            std::vector<T> front;
+            std::vector<T> back;
+            uint64_t frontStart = 0;
+            // Writers may run on worker threads
+            std::mutex mutex;
         };
 
+        // Reads the events written during the previous frame. A reader kept across frames remembers
+        // what it has consumed and only yields newer events, a fresh one sees everything readable
         template<typename T>
         class EventReader final {
         public:
-            bool Has() {
-                return EventStaging<T>::Has();
+            EventReader(EventChannel<T> &channel) : channel(&channel) {}
+
+            // Whether Read() would return anything
+            bool Has() const {
+                return !this->channel->Pending(this->cursor).empty();
             }
 
-            T Read() {
-                return EventStaging<T>::Get();
+            std::span<const T> Read() {
+                auto events = this->channel->Pending(this->cursor);
+                this->cursor = this->channel->End();
+                return events;
             }
-        };
 
-        class Events;
+        private:
+            EventChannel<T> *channel;
+            uint64_t cursor = 0;
+        };
 
         template<typename T>
         class EventWriter final {
         public:
-            EventWriter(Events &e) : e(e) {}
-            void Write(const T &t);
+            EventWriter(EventChannel<T> &channel) : channel(&channel) {}
+
+            void Write(const T &t) {
+                this->channel->Emplace(t);
+            }
+
+            void Write(T &&t) {
+                this->channel->Emplace(std::move(t));
+            }
+
+            // Takes the channel lock once for the whole batch
+            void Write(std::span<const T> events) {
+                this->channel->Append(events);
+            }
 
         private:
-            Events &e;
+            EventChannel<T> *channel;
         };
 
-
         class World;
         class Events final {
         public:
             friend class World;
-            template<typename T>
-            friend class EventWriter;
 
             template<typename T>
-            auto Reader();
+            EventReader<T> Reader() {
+                return EventReader<T>(this->Channel<T>());
+            }
 
             template<typename T>
-            auto Writer();
-
-        private:
-            std::vector<void (*)()> removeEventFuncs;
-            std::vector<void (*)()> removeOldEventFuncs;
-            std::vector<std::function<void()>> addEventFuncs;
-
-            void RemoveOldEvents() {
-                for (auto func : removeOldEventFuncs) {
-                    func();
-                }
-                removeOldEventFuncs = removeEventFuncs;
-                removeEventFuncs.clear();
+            EventWriter<T> Writer() {
+                return EventWriter<T>(this->Channel<T>());
             }
 
-            void AddAllEvents() {
-                for (auto func : addEventFuncs) {
-                    func();
+            template<typename T>
+            EventChannel<T> &Channel() {
+                auto index = IndexGetter<Event>::Get<T>();
+                std::lock_guard lock(this->mutex);
+                if (index >= this->channels.size()) {
+                    this->channels.resize(index + 1);
+                }
+                if (!this->channels[index]) {
+                    this->channels[index] = std::make_unique<EventChannel<T>>();
                 }
-                addEventFuncs.clear();
+                return *static_cast<EventChannel<T> *>(this->channels[index].get());
             }
-        };
 
-        template<typename Category>
-        class IndexGetter final {
-        public:
-            template<typename T>
-            static uint32_t Get() {
-                static uint32_t id = currentIndex++;
-                return id;
-            }
         private:
-            inline static uint32_t currentIndex = 0;
-        };
-
-        template<typename T, typename = std::enable_if<std::is_integral_v<T>>>
-        struct IDGenerator final {
-            static T Generate() {
-                return currentId++;
+            // Indexed by event type id, channels are created on first use which may happen on a worker thread
+            std::vector<std::unique_ptr<EventChannelBase>> channels;
+            std::mutex mutex;
+
+            void Swap() {
+                for (auto &channel : this->channels) {
+                    if (channel) {
+                        channel->Swap();
+                    }
+                }
             }
-        private:
-            inline static T currentId = {};
         };
 
+        // Sparse pages are addressed by the entity index only, so their number is bounded by the peak
+        // live entity count. The dense array keeps full handles, which is what rejects stale ones
         template<typename T, size_t PageSize, typename = std::enable_if<std::is_integral_v<T>>>
         class SparseSet final {
         public:
@@ -156,8 +267,11 @@ namespace engine {
                 assert(t != this->null);
 
                 auto p = this->Page(t);
-                auto o = this->Offset(t);
-                return p < this->sparse.size() && this->sparse[p]->at(o) != this->null;
+                if (p >= this->sparse.size()) {
+                    return false;
+                }
+                auto idx = this->sparse[p]->at(this->Offset(t));
+                return idx != this->null && this->density[idx] == t;
             }
 
             void Clear() {
@@ -165,8 +279,37 @@ namespace engine {
                 this->sparse.clear();
             }
 
+            // Grows geometrically, so that reserving before every batch stays amortized
+            void Reserve(size_t size) {
+                if (size > this->density.capacity()) {
+                    this->density.reserve(std::max(size, this->density.capacity() * 2));
+                }
+            }
+
+            size_t Size() const {
+                return this->density.size();
+            }
+
             auto begin() { return this->density.begin(); }
             auto end() { return this->density.end(); }
+            T operator[](size_t index) const { return this->density[index]; }
+            const T *Data() const { return this->density.data(); }
+
+            // Replaces the content with `count` elements in the given dense order, sparse pages are kept.
+            // The elements are copied bytewise, so `first` needs no alignment
+            void Assign(const void *first, size_t count) {
+                for (auto t : this->density) {
+                    this->Index(t) = this->null;
+                }
+                this->density.resize(count);
+                if (count > 0) {
+                    std::memcpy(this->density.data(), first, count * sizeof(T));
+                }
+                for (size_t i = 0; i < count; i++) {
+                    this->Assure(this->density[i]);
+                    this->Index(this->density[i]) = (T) i;
+                }
+            }
             static constexpr T null = std::numeric_limits<T>::max();
 
         private:
@@ -174,7 +317,7 @@ namespace engine {
             std::vector<std::unique_ptr<std::array<T, PageSize>>> sparse;
         
             size_t Page(T t) const {
-                return t / PageSize;
+                return EntityTraits::ToIndex(t) / PageSize;
             }
 
             T Index(T t) const {
@@ -186,7 +329,7 @@ namespace engine {
             }
 
             size_t Offset(T t) const {
-                return t % PageSize;
+                return EntityTraits::ToIndex(t) % PageSize;
             }
 
             void Assure(T t) {
@@ -200,424 +343,3207 @@ namespace engine {
             }
         };
 
-        class Commands;
-        class Resources;
-        class Querier;
-        using UpdateSystem = void (*)(Commands &, Querier, Resources, Events &);
-        using StartupSystem = void (*)(Commands &);
-
-        class World final {
-        public:
-            friend class Commands;
-            friend class Resources;
-            friend class Querier;
-            using ComponentContainer = std::unordered_map<ComponentID, void *>;
-
-            World() = default;
-            World(const World &) = delete;
-            World &operator=(const World &) = delete;
-
-            World &AddStartupSystem(StartupSystem sys) {
-                this->startups.push_back(sys);
-                return *this;
-            }
+        struct ComponentMeta final {
+            using Relocator = void (*)(void *, void *);
+            using Destructor = void (*)(void *);
+            using Filler = void (*)(void *, const void *, size_t);
+            using Constructor = void (*)(void *);
+
+            size_t size = 0;
+            size_t align = 0;
+            // Move-constructs the element at dst from src and destroys src
+            Relocator relocate = nullptr;
+            Destructor destroy = nullptr;
+            // Copy-constructs `count` consecutive elements at dst from the element at src,
+            // null for types that are not copy constructible
+            Filler fill = nullptr;
+            // Default-constructs the element at dst, null for types without a default constructor
+            Constructor construct = nullptr;
+            // Empty types carry no data, they are tracked by signature and sparse set only
+            bool tag = false;
+            // Rows of trivially copyable types may be copied bytewise, as World snapshots do
+            bool trivial = false;
 
-            World &AddSystem(UpdateSystem sys) {
-                this->updates.push_back(sys);
-                return *this;
+            template<typename T>
+            static const ComponentMeta &Of() {
+                static const ComponentMeta meta = Make<T>();
+                return meta;
             }
 
+        private:
             template<typename T>
-            World &SetResource(T &&resource);
-
-            void Startup();
-            void Update();
-            void Shutdown() {
-                this->entities.clear();
-                this->resources.clear();
-                this->componentMap.clear();
+            static ComponentMeta Make() {
+                ComponentMeta meta;
+                meta.size = sizeof(T);
+                meta.align = alignof(T);
+                meta.tag = std::is_empty_v<T>;
+                meta.trivial = std::is_trivially_copyable_v<T>;
+                meta.relocate = [](void *dst, void *src) {
+                    new (dst) T(std::move(*((T *) src)));
+                    ((T *) src)->~T();
+                };
+                meta.destroy = [](void *elem) {
+                    ((T *) elem)->~T();
+                };
+                if constexpr (std::is_copy_constructible_v<T>) {
+                    meta.fill = [](void *dst, const void *src, size_t count) {
+                        for (size_t i = 0; i < count; i++) {
+                            new ((T *) dst + i) T(*((const T *) src));
+                        }
+                    };
+                }
+                if constexpr (std::is_default_constructible_v<T>) {
+                    meta.construct = [](void *dst) {
+                        new (dst) T();
+                    };
+                }
+                return meta;
             }
+        };
 
-        private:
-            struct Pool final {
-                std::vector<void *> instances;
-                std::vector<void *> cache;
+        // Tags are never stored, every reference to a tag component refers to this instance
+        template<typename T>
+        T &TagInstance() {
+            static_assert(std::is_empty_v<T>, "Only tags share an instance");
+            static std::remove_const_t<T> instance;
+            return instance;
+        }
 
-                using Constructor = void *(*)();
-                using Destructor = void (*)(void*);
-                Constructor cfunc;
-                Destructor dfunc;
+        inline constexpr size_t ARCHETYPE_CHUNK_SIZE = 16 * 1024;
+        inline constexpr size_t ARCHETYPE_CHUNK_ALIGN = 64;
 
-                Pool(Constructor c, Destructor d) : cfunc(c), dfunc(d) {
-                    if (!c) {
-                        std::cerr << std::format("WARN: Pool constructor should be not-null (from pool {})", (void *) this) << std::endl;
-                    }
-                    if (!d) {
-                        std::cerr << std::format("WARN: Pool destructor should be not-null (from pool {})", (void *) this) << std::endl;
-                    }
-                }
-                
-                void *Create() {
-                    if (!cache.empty()) {
-                        this->instances.push_back(this->cache.back());
-                        this->cache.pop_back();
-                    } else {
-                        this->instances.push_back(this->cfunc());
-                    }
-                    return this->instances.back();
-                }
+        // Entities sharing the same component set are stored together in fixed-size chunks,
+        // every chunk holds one contiguous array per component type (plus the entity ids)
+        class Archetype final {
+        public:
+            friend class World;
 
-                void Destroy(void *element) {
-                    if (auto it = std::find(this->instances.begin(), this->instances.end(), element); it != this->instances.end()) {
-                        this->cache.push_back(*it);
-                        std::swap(*it, this->instances.back());
-                        this->instances.pop_back();
-                    } else {
-                        assert(false && "Element not in pool");
-                    }
-                }
+            // `ticks` is the offset of the added ticks of the column, followed by the changed ticks
+            struct Column {
+                ComponentID id;
+                ComponentMeta meta;
+                size_t offset;
+                size_t ticks;
             };
 
-            struct ComponentInfo {
-                Pool pool;
-                SparseSet<Entity, 32> sparseSet;
-                ComponentInfo(Pool::Constructor c, Pool::Destructor d) : pool(c, d) {}
-                ComponentInfo() : pool(nullptr, nullptr) {}
-            
-                void AddEntity(Entity entity) {
-                    this->sparseSet.Add(entity);
+            // `metas` holds the meta of every component in the signature, in ascending id order
+            Archetype(const Signature &signature, const std::vector<ComponentMeta> &metas) : signature(signature) {
+                this->columnIndex.fill(-1);
+                size_t rowSize = sizeof(Entity);
+                for (ComponentID id = 0; id < MAX_COMPONENT_TYPES; id++) {
+                    if (!signature.test(id)) {
+                        continue;
+                    }
+                    auto &meta = metas[this->types.size()];
+                    assertm(meta.align <= ARCHETYPE_CHUNK_ALIGN, "Component alignment exceeds chunk alignment");
+                    this->columnIndex[id] = (int16_t) this->columns.size();
+                    this->types.push_back(id);
+                    this->columns.push_back(Column { id, meta, 0, 0 });
+                    rowSize += meta.size + 2 * sizeof(uint32_t);
                 }
+                assert(this->types.size() == metas.size());
 
-                void RemoveEntity(Entity entity) {
-                    this->sparseSet.Remove(entity);
+                this->chunkCapacity = std::max<size_t>(1, ARCHETYPE_CHUNK_SIZE / rowSize);
+                while (this->chunkCapacity > 1 && this->Layout(this->chunkCapacity) > ARCHETYPE_CHUNK_SIZE) {
+                    this->chunkCapacity--;
                 }
-            };
-
-            using ComponentMap = std::unordered_map<ComponentID, ComponentInfo>;
-            ComponentMap componentMap;
-            std::unordered_map<Entity, ComponentContainer> entities;
-            Events events;
-
+                this->chunkBytes = std::max(ARCHETYPE_CHUNK_SIZE, this->Layout(this->chunkCapacity));
+            }
 
-            struct ResourceInfo {
-                void *resource = nullptr;
-                using Destructor = void (*)(void *);
-                Destructor dtor = nullptr;
+            Archetype(const Archetype &) = delete;
+            Archetype &operator=(const Archetype &) = delete;
 
-                ResourceInfo(Destructor d) : dtor(d) {
-                    assert(d && "Resource destructor should be not-null");
+            ~Archetype() {
+                for (size_t row = 0; row < this->count; row++) {
+                    for (size_t c = 0; c < this->columns.size(); c++) {
+                        this->columns[c].meta.destroy(this->Get(c, row));
+                    }
+                }
+                for (auto chunk : this->chunks) {
+                    ::operator delete(chunk, std::align_val_t(ARCHETYPE_CHUNK_ALIGN));
                 }
+            }
 
-                ResourceInfo() = default;
+            const std::vector<ComponentID> &GetTypes() const { return this->types; }
+            const Signature &GetSignature() const { return this->signature; }
+            size_t Size() const { return this->count; }
+            size_t GetChunkCapacity() const { return this->chunkCapacity; }
 
-                ~ResourceInfo() {
-                    this->dtor(this->resource);
-                }
-            };
+            size_t GetChunkCount() const {
+                return (this->count + this->chunkCapacity - 1) / this->chunkCapacity;
+            }
 
-            std::unordered_map<ComponentID, ResourceInfo> resources;
-            std::vector<StartupSystem> startups;
-            std::vector<UpdateSystem> updates;
-        };
+            size_t GetChunkSize(size_t chunk) const {
+                return std::min(this->chunkCapacity, this->count - chunk * this->chunkCapacity);
+            }
 
-        using EntityGenerator = IDGenerator<Entity>;
-        class Commands final {
-        public:
-            Commands(World &world) : world(world) {}
+            int FindColumn(ComponentID id) const {
+                return this->columnIndex[id];
+            }
 
-            template<typename ...ComponentTypes>
-            Commands &Spawn(ComponentTypes &&...components) {
-                this->Spawned<ComponentTypes...>(std::forward<ComponentTypes>(components)...);
-                return *this;
+            bool Contains(ComponentID id) const {
+                return this->signature.test(id);
             }
 
-            template<typename ...ComponentTypes>
-            Entity Spawned(ComponentTypes &&...components) {
-                EntitySpawnInfo info;
-                info.entity = EntityGenerator::Generate();
-                this->DoSpawn(info.entity, info.components, std::forward<ComponentTypes>(components)...);
-                // FIXED ?
-                this->spawnedEntities.push_back(info);
-                return info.entity;
+            Entity *Entities(size_t chunk) {
+                return (Entity *) this->chunks[chunk];
             }
 
-            Commands &Destroy(Entity entity) {
-                // if (auto it = this->world.entities.find(entity); it != this->world.entities.end()) {
-                //     for (auto [id, component] : it->second) {
-                //         auto &componentInfo = this->world.componentMap[id];
-                //         componentInfo.pool.Destroy(component);
-                //         componentInfo.sparseSet.Remove(entity);
-
-                //     }
-                //     this->world.entities.erase(it);
-                // }
-                destroyedEntities.push_back(entity);
-                return *this;
+            void *ColumnData(size_t column, size_t chunk) {
+                return this->chunks[chunk] + this->columns[column].offset;
+            }
+
+            void *Get(size_t column, size_t row) {
+                auto &col = this->columns[column];
+                return this->chunks[row / this->chunkCapacity] + col.offset + (row % this->chunkCapacity) * col.meta.size;
             }
 
+            // Tags have no column, every entity carrying one shares the same instance
             template<typename T>
-            Commands &SetResource(T &&resource) {
-                auto index = IndexGetter<Resource>::Get<T>();
-                if (auto it = this->world.resources.find(index); it != this->world.resources.end()) {
-                    assert(it->second.resource && "Resource already exists");
-                    it->second.resource = new T(std::forward<T>(resource));
+            T &Fetch(int column, size_t row) {
+                if constexpr (std::is_empty_v<T>) {
+                    return TagInstance<T>();
                 } else {
-                    auto newIt = this->world.resources.emplace(index, World::ResourceInfo(
-                        [](void *elem) { delete (T *) elem; } 
-                    ));
-                    newIt.first->second.resource = new T;
-                    *(T *)(newIt.first->second.resource) = std::forward<T>(resource);
+                    return *((T *) this->Get(column, row));
                 }
-                return *this;
             }
 
-            template<typename T>
-            Commands &RemoveResource() {
-                auto index = IndexGetter<Resource>::Get<T>();
-                // if (auto it = this->world.resources.find(index); it == this->world.resources.end()) {
-                //     delete (T *) it->second.resource;
-                // }
-                this->destroyInfo.push_back(ResourceDestroyInfo(index, [](void *elem) { delete (T *) elem; }));
-                return *this;
+            // Tick at which the component was inserted, per row of the chunk
+            uint32_t *AddedTicks(size_t column, size_t chunk) {
+                return (uint32_t *) (this->chunks[chunk] + this->columns[column].ticks);
             }
 
-            void Execute() {
-                for (auto info : this->destroyInfo) {
-                    this->ExecuteRemoveResource(info);
-                }
-                for (auto e : this->destroyedEntities) {
-                    this->ExecuteDestroy(e);
-                }
-                for (auto &spawnInfo : spawnedEntities) {
-                    auto it = this->world.entities.emplace(spawnInfo.entity, World::ComponentContainer {});
-                    auto &compContainer = it.first->second;
-                    for (auto &componentInfo : spawnInfo.components) {
-                        compContainer[componentInfo.index] = this->DoSpawnWithoutComponentTypes(spawnInfo.entity, componentInfo);
-                    }
-                }
+            // Tick of the last mutable access to the component, per row of the chunk
+            uint32_t *ChangedTicks(size_t column, size_t chunk) {
+                return this->AddedTicks(column, chunk) + this->chunkCapacity;
             }
 
-        private:
-            World &world;
-            std::vector<Entity> destroyedEntities;
-
-            using DestroyFunc = void (*)(void *);
-            using AssignFunc = std::function<void (void *)>;
+            uint32_t &AddedTick(size_t column, size_t row) {
+                return this->AddedTicks(column, row / this->chunkCapacity)[row % this->chunkCapacity];
+            }
 
-            struct ResourceDestroyInfo {
-                uint32_t index;
-                DestroyFunc Destroy;
+            uint32_t &ChangedTick(size_t column, size_t row) {
+                return this->ChangedTicks(column, row / this->chunkCapacity)[row % this->chunkCapacity];
+            }
 
-                ResourceDestroyInfo(uint32_t index, DestroyFunc func) : index(index), Destroy(func) {}
-            };
-            std::vector<ResourceDestroyInfo> destroyInfo;
+            // Marks `count` rows from `first` on as inserted at `tick`
+            void Stamp(size_t column, size_t first, size_t count, uint32_t tick) {
+                for (size_t row = first; row < first + count; row++) {
+                    this->AddedTick(column, row) = tick;
+                    this->ChangedTick(column, row) = tick;
+                }
+            }
 
-            struct ComponentSpawnInfo {
-                AssignFunc assign;
-                World::Pool::Constructor cfunc;
-                World::Pool::Destructor dfunc;
-                ComponentID index;
-            };
+            Entity GetEntity(size_t row) {
+                return this->Entities(row / this->chunkCapacity)[row % this->chunkCapacity];
+            }
 
-            struct EntitySpawnInfo {
-                Entity entity;
-                std::vector<ComponentSpawnInfo> components;
-            };
-            std::vector<EntitySpawnInfo> spawnedEntities;
+            // Makes sure `rows` rows fit without allocating further chunks
+            void Reserve(size_t rows) {
+                while (this->chunks.size() * this->chunkCapacity < rows) {
+                    this->chunks.push_back((std::byte *) ::operator new(this->chunkBytes, std::align_val_t(ARCHETYPE_CHUNK_ALIGN)));
+                }
+            }
 
-            template<typename T, typename ...Remains>
-            void DoSpawn(Entity entity, std::vector<ComponentSpawnInfo> &spawnInfo, T &&component, Remains &&...remains) {
-                ComponentSpawnInfo info;
-                info.index = IndexGetter<Component>::Get<T>();
-                info.cfunc = []() -> void * {
-                    return new T;
-                };
-                info.dfunc = [](void *elem) {
-                    delete (T *) elem;
-                };
-                info.assign = [=](void *elem) {
-                    *((T *) elem) = component;
-                };
-                spawnInfo.push_back(info);
+            // Appends a row for the entity, component memory is left uninitialized
+            size_t Allocate(Entity entity) {
+                return this->Allocate(&entity, 1);
+            }
 
-                if constexpr (sizeof...(Remains) != 0) {
-                    DoSpawn<Remains...>(entity, spawnInfo, std::forward<Remains>(remains)...);
+            // Appends consecutive rows for the entities and returns the first one
+            size_t Allocate(const Entity *entities, size_t count) {
+                auto first = this->count;
+                this->Reserve(first + count);
+                for (size_t i = 0; i < count; i++) {
+                    auto row = first + i;
+                    this->Entities(row / this->chunkCapacity)[row % this->chunkCapacity] = entities[i];
                 }
+                this->count += count;
+                return first;
             }
 
-            void *DoSpawnWithoutComponentTypes(Entity entity, ComponentSpawnInfo &info) {
-                if (auto it = this->world.componentMap.find(info.index); it == this->world.componentMap.end()) {
-                    this->world.componentMap.emplace(
-                        info.index,
-                        World::ComponentInfo(info.cfunc, info.dfunc)
-                    );
+            // Copy-constructs the prototype into `count` uninitialized rows from `first` on,
+            // one contiguous run per chunk
+            void Fill(size_t column, size_t first, size_t count, const void *prototype) {
+                auto &col = this->columns[column];
+                assertm(col.meta.fill, "Component type is not copy constructible");
+                while (count > 0) {
+                    auto offset = first % this->chunkCapacity;
+                    auto run = std::min(count, this->chunkCapacity - offset);
+                    col.meta.fill(this->chunks[first / this->chunkCapacity] + col.offset + offset * col.meta.size, prototype, run);
+                    first += run;
+                    count -= run;
                 }
-                auto &componentInfo = this->world.componentMap[info.index];
-                void *element = componentInfo.pool.Create();
-                // *((T *) element) = std::forward<T>(component);
-                info.assign(element);
-                componentInfo.sparseSet.Add(entity);
-                return element;
             }
 
-            void ExecuteDestroy(Entity entity) {
-                if (auto it = this->world.entities.find(entity); it != this->world.entities.end()) {
-                    for (auto [id, component] : it->second) {
-                        auto &componentInfo = this->world.componentMap[id];
-                        componentInfo.pool.Destroy(component);
-                        componentInfo.sparseSet.Remove(entity);
+            // Destroys the components of the row and fills the hole with the last row,
+            // returns the entity which has been moved into the row (or null if none)
+            Entity Remove(size_t row) {
+                for (size_t c = 0; c < this->columns.size(); c++) {
+                    this->columns[c].meta.destroy(this->Get(c, row));
+                }
+                return this->Detach(row);
+            }
 
+            // Same as Remove, but the components of the row must have been relocated or destroyed already
+            Entity Detach(size_t row) {
+                assert(row < this->count);
+                auto last = this->count - 1;
+                Entity moved = EntityTraits::null;
+                if (row != last) {
+                    for (size_t c = 0; c < this->columns.size(); c++) {
+                        this->columns[c].meta.relocate(this->Get(c, row), this->Get(c, last));
+                        this->AddedTick(c, row) = this->AddedTick(c, last);
+                        this->ChangedTick(c, row) = this->ChangedTick(c, last);
                     }
-                    this->world.entities.erase(it);
+                    moved = this->GetEntity(last);
+                    this->Entities(row / this->chunkCapacity)[row % this->chunkCapacity] = moved;
                 }
+                this->count--;
+                return moved;
             }
 
-            void ExecuteRemoveResource(ResourceDestroyInfo &info) {
-                if (auto it = this->world.resources.find(info.index); it == this->world.resources.end()) {
-                    info.Destroy(it->second.resource);
+            // Destroys every row, chunks are kept
+            void Clear() {
+                for (size_t row = 0; row < this->count; row++) {
+                    for (size_t c = 0; c < this->columns.size(); c++) {
+                        this->columns[c].meta.destroy(this->Get(c, row));
+                    }
                 }
+                this->count = 0;
             }
-        };
 
-        class Resources final {
-        public:
-            Resources(World &world) : world(world) {}
-        
-            template<typename T>
-            bool Has() const {
-                auto index = IndexGetter<Resource>::Get<T>();
-                auto it = this->world.resources.find(index);
-                return it != this->world.resources.end() && it->second.resource;
+            // Rows can be copied bytewise, chunk by chunk
+            bool IsTrivial() const {
+                return std::all_of(this->columns.begin(), this->columns.end(), [](const Column &col) { return col.meta.trivial; });
             }
 
-            template<typename T>
-            T &Get() {
-                auto index = IndexGetter<Resource>::Get<T>();
-                return *((T *) world.resources[index].resource);
+            // Frees the chunks emptied by removals but a single spare one. Called once per frame rather
+            // than on every removal, so despawning and respawning a wave in the same frame reuses chunks
+            void Trim() {
+                while (this->chunks.size() > this->GetChunkCount() + 1) {
+                    ::operator delete(this->chunks.back(), std::align_val_t(ARCHETYPE_CHUNK_ALIGN));
+                    this->chunks.pop_back();
+                }
             }
+
         private:
-            World &world;
+            Signature signature;
+            std::vector<ComponentID> types;
+            std::vector<Column> columns;
+            std::array<int16_t, MAX_COMPONENT_TYPES> columnIndex;
+            std::vector<std::byte *> chunks;
+            size_t chunkCapacity = 0;
+            size_t chunkBytes = 0;
+            size_t count = 0;
+            // Position in World::archetypes, which only grows until shutdown
+            size_t index = 0;
+
+            std::unordered_map<ComponentID, Archetype *> addEdges;
+            std::unordered_map<ComponentID, Archetype *> removeEdges;
+
+            size_t Layout(size_t capacity) {
+                size_t offset = capacity * sizeof(Entity);
+                for (auto &col : this->columns) {
+                    offset = (offset + col.meta.align - 1) / col.meta.align * col.meta.align;
+                    col.offset = offset;
+                    offset += capacity * col.meta.size;
+                    offset = (offset + alignof(uint32_t) - 1) / alignof(uint32_t) * alignof(uint32_t);
+                    col.ticks = offset;
+                    offset += capacity * 2 * sizeof(uint32_t);
+                }
+                return offset;
+            }
         };
 
-        class Querier final {
+        // Declares which components and resources a system reads or writes, systems whose
+        // accesses do not conflict may be run concurrently by World::Update. Change ticks are written
+        // by every non-const fetch (Get<T>, View<T>, Group<T>, ChunkView::Column<T>), so components
+        // declared with Read<T> have to be fetched as `const T`, which is asserted
+        class SystemAccess final {
         public:
-            Querier(World &world) : world(world) {}
-    
-            template<typename ...Components>
-            std::vector<Entity> Query() {
-                std::vector<Entity> entities;
-                DoQuery<Components...>(entities);
-                return entities;
+            template<typename ...Ts>
+            SystemAccess &Read() {
+                (this->reads.set(IndexGetter<Component>::Get<Ts>()), ...);
+                return *this;
             }
 
-            template<typename T>
-            bool Has(Entity entity) {
-                auto it = world.entities.find(entity);
-                auto index = IndexGetter<Component>::Get<T>();
-                return it != world.entities.end() && it->second.find(index) != it->second.end();
+            template<typename ...Ts>
+            SystemAccess &Write() {
+                (this->writes.set(IndexGetter<Component>::Get<Ts>()), ...);
+                return *this;
             }
 
-            template<typename T>
-            T &Get(Entity entity) {
-                auto index = IndexGetter<Component>::Get<T>();
-                return *((T *) world.entities[entity][index]);
+            template<typename ...Ts>
+            SystemAccess &ReadResource() {
+                (this->resourceReads.set(IndexGetter<Resource>::Get<Ts>()), ...);
+                return *this;
             }
 
-        private:
-            World &world;
+            template<typename ...Ts>
+            SystemAccess &WriteResource() {
+                (this->resourceWrites.set(IndexGetter<Resource>::Get<Ts>()), ...);
+                return *this;
+            }
 
-            template<typename T, typename ...Remains>
-            void DoQuery(std::vector<Entity> &out) {
-                auto index = IndexGetter<Component>::Get<T>();
-                if (world.componentMap.find(index) == world.componentMap.end()) {
-                    return;
-                }
-                World::ComponentInfo &info = world.componentMap.at(index);
+            // For systems that call into SDL (rendering, input, audio)
+            SystemAccess &MainThread() {
+                this->mainThread = true;
+                return *this;
+            }
 
-                for (auto e : info.sparseSet) {
-                    if constexpr (sizeof...(Remains) != 0) {
-                        // return DoQueryRemains<Remains...>(e, out);
-                        DoQueryRemains<Remains...>(e, out);
-                    } else {
-                        out.push_back(e);
-                    }
-                }
-                // return !out.empty();
+            // Conflicts with every other system, for systems that cannot state what they touch
+            // or that add/remove resources through Commands
+            SystemAccess &Exclusive() {
+                this->exclusive = true;
+                this->mainThread = true;
+                return *this;
             }
 
-            template<typename T, typename ...Remains>
-            void DoQueryRemains(Entity entity, std::vector<Entity> &out) {
-                auto index = IndexGetter<Component>::Get<T>();
-                auto &componentContainer = world.entities[entity];
-                if (auto it = componentContainer.find(index); it == componentContainer.end()) {
-                    //return false;
-                    return;
-                }
+            bool IsMainThread() const {
+                return this->mainThread;
+            }
 
-                if constexpr (sizeof...(Remains) == 0) {
-                    out.push_back(entity);
-                    // return true;
-                } else {
-                    //return DoQueryRemains<Remains...>(entity, out);
-                    DoQueryRemains<Remains...>(entity, out);
+            // Whether the system may mark the component as changed
+            bool Writes(ComponentID component) const {
+                return this->exclusive || this->writes.test(component);
+            }
+
+            bool ConflictsWith(const SystemAccess &other) const {
+                if (this->exclusive || other.exclusive) {
+                    return true;
+                }
+                return (this->writes & (other.reads | other.writes)).any()
+                    || (other.writes & this->reads).any()
+                    || (this->resourceWrites & (other.resourceReads | other.resourceWrites)).any()
+                    || (other.resourceWrites & this->resourceReads).any();
+            }
+
+        private:
+            Signature reads;
+            Signature writes;
+            Signature resourceReads;
+            Signature resourceWrites;
+            bool mainThread = false;
+            bool exclusive = false;
+        };
+
+        // Chunk handed to chunk iteration callbacks, columns the archetype does not have yield nullptr.
+        // Fetching a non-const column marks the whole column of the chunk as changed
+        class ChunkView final {
+        public:
+            ChunkView(Archetype &archetype, size_t chunk, uint32_t tick, const SystemAccess *access = nullptr)
+                : archetype(archetype), chunk(chunk), tick(tick), access(access) {}
+
+            size_t Size() const {
+                return this->archetype.GetChunkSize(this->chunk);
+            }
+
+            Entity *Entities() {
+                return this->archetype.Entities(this->chunk);
+            }
+
+            template<typename T>
+            T *Column() {
+                auto id = IndexGetter<Component>::Get<std::remove_const_t<T>>();
+                auto column = this->archetype.FindColumn(id);
+                if (column < 0) {
+                    return nullptr;
+                }
+                if constexpr (!std::is_const_v<T>) {
+                    assertm(!this->access || this->access->Writes(id), "Non-const fetch of a component the system does not write");
+                    std::fill_n(this->archetype.ChangedTicks(column, this->chunk), this->Size(), this->tick);
+                }
+                return (T *) this->archetype.ColumnData(column, this->chunk);
+            }
+
+        private:
+            Archetype &archetype;
+            size_t chunk;
+            uint32_t tick;
+            const SystemAccess *access;
+        };
+
+        class Commands;
+        class Resources;
+        class Querier;
+        using UpdateSystem = void (*)(Commands &, Querier, Resources, Events &);
+        using StartupSystem = void (*)(Commands &);
+
+        // Resource set by World::Advance before every update and render pass
+        struct Time {
+            // Seconds covered by the current update, the fixed step when one is set
+            float delta = 0;
+            // How far the frame is into the next fixed step, in [0, 1). Render systems interpolate
+            // between the last two simulated states with it
+            float alpha = 1;
+            // Updates run so far
+            uint64_t ticks = 0;
+        };
+
+        inline constexpr size_t PROFILE_WINDOW = 128;
+
+        using ProfileClock = std::chrono::steady_clock;
+
+        // Timings over the last PROFILE_WINDOW frames, in milliseconds
+        struct ProfileStats {
+            std::string name;
+            double last = 0;
+            double min = 0;
+            double avg = 0;
+            double p99 = 0;
+        };
+
+        // Rolling per-slot timings. A slot sums what it records during a frame, EndFrame turns the sum into
+        // a sample. Each slot must only be recorded from one thread at a time, slots are added up front
+        class Profiler final {
+        public:
+            size_t AddSlot(const std::string &name) {
+                this->slots.push_back(Slot { name });
+                return this->slots.size() - 1;
+            }
+
+            void Record(size_t slot, ProfileClock::time_point start) {
+                auto &target = this->slots[slot];
+                target.current += std::chrono::duration<double, std::milli>(ProfileClock::now() - start).count();
+                target.ran = true;
+            }
+
+            size_t GetSlotCount() const {
+                return this->slots.size();
+            }
+
+            ProfileStats GetStats(size_t slot) const {
+                auto &source = this->slots[slot];
+                ProfileStats stats { source.name };
+                auto count = std::min(source.count, PROFILE_WINDOW);
+                if (count == 0) {
+                    return stats;
+                }
+                std::array<float, PROFILE_WINDOW> sorted;
+                std::copy_n(source.samples.begin(), count, sorted.begin());
+                std::sort(sorted.begin(), sorted.begin() + count);
+                stats.last = source.samples[(source.count - 1) % PROFILE_WINDOW];
+                stats.min = sorted[0];
+                stats.avg = std::accumulate(sorted.begin(), sorted.begin() + count, 0.0) / count;
+                stats.p99 = sorted[std::min(count - 1, count * 99 / 100)];
+                return stats;
+            }
+
+            std::vector<ProfileStats> GetStats() const {
+                std::vector<ProfileStats> stats;
+                for (size_t i = 0; i < this->slots.size(); i++) {
+                    stats.push_back(this->GetStats(i));
+                }
+                return stats;
+            }
+
+            // Writes one CSV row per frame with the time of every slot, empty when the slot did not run
+            bool OpenTrace(const std::string &path) {
+                this->trace.open(path, std::ios::out | std::ios::trunc);
+                if (!this->trace) {
+                    return false;
+                }
+                this->trace << "frame";
+                for (auto &slot : this->slots) {
+                    this->trace << "," << slot.name;
+                }
+                this->trace << "\n";
+                this->tracedSlots = this->slots.size();
+                return true;
+            }
+
+            void CloseTrace() {
+                this->trace.close();
+            }
+
+            void EndFrame() {
+                if (this->trace.is_open()) {
+                    this->trace << this->frame;
+                }
+                for (size_t i = 0; i < this->slots.size(); i++) {
+                    auto &slot = this->slots[i];
+                    if (this->trace.is_open() && i < this->tracedSlots) {
+                        this->trace << ",";
+                        if (slot.ran) {
+                            this->trace << slot.current;
+                        }
+                    }
+                    if (slot.ran) {
+                        slot.samples[slot.count++ % PROFILE_WINDOW] = (float) slot.current;
+                        slot.current = 0;
+                        slot.ran = false;
+                    }
+                }
+                if (this->trace.is_open()) {
+                    this->trace << "\n";
+                }
+                this->frame++;
+            }
+
+        private:
+            struct Slot {
+                std::string name;
+                std::array<float, PROFILE_WINDOW> samples {};
+                size_t count = 0;
+                double current = 0;
+                bool ran = false;
+            };
+
+            std::vector<Slot> slots;
+            std::ofstream trace;
+            size_t tracedSlots = 0;
+            uint64_t frame = 0;
+        };
+
+        class World final {
+        public:
+            friend class Commands;
+            friend class Resources;
+            friend class Querier;
+            template<typename ...Components>
+            friend class View;
+            template<typename ...Components>
+            friend class Group;
+
+            // Indexed by entity index, `entity` is the handle currently living in the slot (null if none)
+            // and `row` is the entity's slot inside the archetype. The signature includes tags, which
+            // are left out of the archetype's
+            struct EntityRecord {
+                Signature signature;
+                Archetype *archetype = nullptr;
+                size_t row = 0;
+                Entity entity = EntityTraits::null;
+            };
+
+            // Called with every entity of a batch, see OnAdd
+            using Observer = std::function<void(World &, std::span<const Entity>)>;
+
+            World() {
+                this->destroySlot = this->profiler.AddSlot("commands.destroy");
+                this->spawnSlot = this->profiler.AddSlot("commands.spawn");
+                this->changeSlot = this->profiler.AddSlot("commands.change");
+                this->observeSlot = this->profiler.AddSlot("commands.observe");
+            }
+
+            World(const World &) = delete;
+            World &operator=(const World &) = delete;
+
+            // Observers run from Commands::Execute, once per component type and buffer with all the entities
+            // the buffer affected. OnAdd and OnReplace run after the change, OnRemove (destroys included) runs
+            // before it, so the component can still be read. They must not change entities or components
+            // directly, but may record into a Commands buffer of their own
+            template<typename T>
+            World &OnAdd(Observer observer) {
+                auto id = IndexGetter<Component>::Get<T>();
+                this->ObserversOf(id).onAdd.push_back(std::move(observer));
+                this->observedAdd.set(id);
+                return *this;
+            }
+
+            template<typename T>
+            World &OnRemove(Observer observer) {
+                auto id = IndexGetter<Component>::Get<T>();
+                this->ObserversOf(id).onRemove.push_back(std::move(observer));
+                this->observedRemove.set(id);
+                return *this;
+            }
+
+            // Inserting a component the entity already has
+            template<typename T>
+            World &OnReplace(Observer observer) {
+                static_assert(!std::is_empty_v<T>, "Tags are never replaced");
+                auto id = IndexGetter<Component>::Get<T>();
+                this->ObserversOf(id).onReplace.push_back(std::move(observer));
+                this->observedReplace.set(id);
+                return *this;
+            }
+
+            // Unnamed systems are profiled as "startup #i", "update #i" and "render #i"
+            World &AddStartupSystem(StartupSystem sys, const std::string &name = "") {
+                this->startups.push_back(sys);
+                this->startupSlots.push_back(this->profiler.AddSlot(name.empty() ? std::format("startup #{}", this->startups.size() - 1) : name));
+                return *this;
+            }
+
+            // Systems registered without an access declaration are exclusive
+            World &AddSystem(UpdateSystem sys, const std::string &name = "") {
+                return this->AddSystem(sys, SystemAccess().Exclusive(), name);
+            }
+
+            // A system waits for every previously added system it conflicts with,
+            // so conflicting systems still observe each other in registration order
+            World &AddSystem(UpdateSystem sys, const SystemAccess &access, const std::string &name = "") {
+                auto index = this->updates.size();
+                SystemInfo info { sys, access };
+                info.profileSlot = this->profiler.AddSlot(name.empty() ? std::format("update #{}", index) : name);
+                for (size_t i = 0; i < index; i++) {
+                    if (this->updates[i].access.ConflictsWith(access)) {
+                        this->updates[i].dependents.push_back(index);
+                        info.dependencyCount++;
+                    }
+                }
+                this->updates.push_back(std::move(info));
+                return *this;
+            }
+
+            // Render systems run once per Advance after the updates, in registration order on the calling thread
+            World &AddRenderSystem(UpdateSystem sys, const std::string &name = "") {
+                SystemInfo info { sys, SystemAccess().Exclusive() };
+                info.profileSlot = this->profiler.AddSlot(name.empty() ? std::format("render #{}", this->renders.size()) : name);
+                this->renders.push_back(std::move(info));
+                return *this;
+            }
+
+            // Timings of every system and of command playback, a frame ends with each Update or Advance
+            Profiler &GetProfiler() {
+                return this->profiler;
+            }
+
+            // With a step set, Advance runs the update systems every `step` seconds of frame time, at most
+            // `maxTicks` times per call. Without one (0) they run once per Advance with the frame time
+            World &SetFixedTimestep(float step, uint32_t maxTicks = 8) {
+                assertm(maxTicks > 0, "Fixed timestep needs at least one update per advance");
+                this->fixedStep = step;
+                this->maxTicks = maxTicks;
+                this->accumulator = 0;
+                return *this;
+            }
+
+            World &SetWorkerCount(size_t count) {
+                std::lock_guard lock(this->poolMutex);
+                this->pool = std::make_unique<ThreadPool>(count);
+                return *this;
+            }
+
+            ThreadPool &GetPool() {
+                std::lock_guard lock(this->poolMutex);
+                if (!this->pool) {
+                    this->pool = std::make_unique<ThreadPool>();
+                }
+                return *this->pool;
+            }
+
+            template<typename T>
+            World &SetResource(T &&resource);
+
+            // Sets a default-constructed T unless the world has one, for resources systems keep across updates
+            template<typename T>
+            World &InitResource();
+
+            // Writes the entities, the components and the trivially copyable resources into `out`. Trivially
+            // copyable components are copied bytewise and types persisted with a codec go through it. Other
+            // components have to be marked Transient, capturing one that is not asserts. Events and the change
+            // tick are left out
+            void Capture(std::vector<std::byte> &out) const;
+            // Puts the world back in the state of a snapshot it captured. Resources removed since are not
+            // brought back, archetypes created since are emptied
+            void Restore(std::span<const std::byte> snapshot);
+
+            // Opts a component that is not trivially copyable out of snapshots, Restore default-constructs it.
+            // For state that is rebuilt anyway, like caches and callbacks set up again by a system
+            template<typename T>
+            World &Transient() {
+                static_assert(std::is_default_constructible_v<T>, "Transient components are restored default-constructed");
+                auto id = IndexGetter<Component>::Get<T>();
+                this->RegisterComponent(id, ComponentMeta::Of<T>());
+                this->transient.set(id);
+                return *this;
+            }
+
+            // Component types written by Save and recognized by Load, under a name that has to stay the same
+            // across builds. Trivially copyable types are stored as raw column blocks, other types go through
+            // the codec drefl generates from the fields registered with drefl::RegistReflection<T>()
+            template<typename T>
+            World &Persist(const std::string &name) {
+                if constexpr (std::is_trivially_copyable_v<T>) {
+                    return this->Persist(IndexGetter<Component>::Get<T>(), ComponentMeta::Of<T>(), name, {}, {});
+                } else {
+                    static_assert(std::is_default_constructible_v<T>, "Reflected components are decoded into a default-constructed one");
+                    return this->Persist(IndexGetter<Component>::Get<T>(), ComponentMeta::Of<T>(), name,
+                        [](const void *component, std::vector<std::byte> &out) {
+                            drefl::Encode(*((const T *) component), out);
+                        },
+                        [](void *component, std::span<const std::byte> block, size_t &cursor) {
+                            drefl::Decode(*new (component) T(), block, cursor);
+                        }
+                    );
+                }
+            }
+
+            // With a hand-written codec, written component by component. `read` gets the block and a cursor to advance
+            template<typename T>
+            World &Persist(const std::string &name, void (*write)(const T &, std::vector<std::byte> &),
+                           T (*read)(std::span<const std::byte>, size_t &)) {
+                static_assert(!std::is_empty_v<T>, "Tags carry no data to encode");
+                return this->Persist(IndexGetter<Component>::Get<T>(), ComponentMeta::Of<T>(), name,
+                    [write](const void *component, std::vector<std::byte> &out) {
+                        write(*((const T *) component), out);
+                    },
+                    [read](void *component, std::span<const std::byte> block, size_t &cursor) {
+                        new (component) T(read(block, cursor));
+                    }
+                );
+            }
+
+            // Writes the entities and their persisted components to a versioned binary file, see
+            // detail::WorldFileHeader. Components of other types, resources and events are left out
+            bool Save(const std::string &path) const;
+            // Loads a file written by Save into an empty world, every type in it must be persisted here as well.
+            // Entities keep their handles, observers are not notified
+            bool Load(const std::string &path);
+
+            // False for destroyed entities, even after their slot has been reused
+            bool IsAlive(Entity entity) const {
+                auto index = EntityTraits::ToIndex(entity);
+                return index < this->entities.size() && this->entities[index].entity == entity;
+            }
+
+            void Startup();
+            void Update();
+            // Runs the updates the frame time adds up to, then the render systems. Returns the number of updates run
+            uint32_t Advance(float frameTime);
+            void Shutdown() {
+                this->commandBuffers.clear();
+                this->parallelBuffers.clear();
+                this->entities.clear();
+                this->freeEntities.clear();
+                this->nextEntityIndex = 0;
+                this->archetypeIndex.clear();
+                this->archetypes.clear();
+                for (auto &[mask, group] : this->groups) {
+                    group->archetypes.clear();
+                }
+                this->resources.clear();
+                this->componentInfos.clear();
+                this->accumulator = 0;
+            }
+
+        private:
+            struct ComponentInfo {
+                bool registered = false;
+                ComponentMeta meta;
+                SparseSet<Entity, 32> sparseSet;
+                ComponentInfo(const ComponentMeta &meta) : registered(true), meta(meta) {}
+                ComponentInfo() = default;
+
+                void AddEntity(Entity entity) {
+                    this->sparseSet.Add(entity);
+                }
+
+                void RemoveEntity(Entity entity) {
+                    this->sparseSet.Remove(entity);
+                }
+            };
+
+            // Indexed by component id
+            std::vector<ComponentInfo> componentInfos;
+            // Indexed by entity index
+            std::vector<EntityRecord> entities;
+            // Released handles, already carrying the generation of their next use. Entities are
+            // allocated while recording commands, which may happen on worker threads
+            std::vector<Entity> freeEntities;
+            uint32_t nextEntityIndex = 0;
+            std::mutex entityMutex;
+            std::vector<std::unique_ptr<Archetype>> archetypes;
+            std::unordered_map<Signature, Archetype *> archetypeIndex;
+            // Archetypes holding all the components of a group, kept up to date as archetypes are created
+            struct GroupInfo {
+                Signature mask;
+                std::vector<Archetype *> archetypes;
+            };
+            std::unordered_map<Signature, std::unique_ptr<GroupInfo>> groups;
+            std::mutex groupMutex;
+            Signature tagMask;
+            Events events;
+
+            ComponentInfo *FindComponent(ComponentID id) {
+                if (id >= this->componentInfos.size() || !this->componentInfos[id].registered) {
+                    return nullptr;
+                }
+                return &this->componentInfos[id];
+            }
+
+            ComponentInfo &RegisterComponent(ComponentID id, const ComponentMeta &meta) {
+                assertm(id < MAX_COMPONENT_TYPES, "Too many component types, raise MAX_COMPONENT_TYPES");
+                if (id >= this->componentInfos.size()) {
+                    this->componentInfos.resize(id + 1);
+                }
+                if (!this->componentInfos[id].registered) {
+                    this->componentInfos[id] = ComponentInfo(meta);
+                    if (meta.tag) {
+                        this->tagMask.set(id);
+                    }
+                }
+                return this->componentInfos[id];
+            }
+
+            // Archetypes are keyed by the components that have storage
+            Signature StorageSignature(const Signature &signature) const {
+                return signature & ~this->tagMask;
+            }
+
+            EntityRecord &Record(Entity entity) {
+                return this->entities[EntityTraits::ToIndex(entity)];
+            }
+
+            Entity AllocateEntity() {
+                std::lock_guard lock(this->entityMutex);
+                if (!this->freeEntities.empty()) {
+                    auto entity = this->freeEntities.back();
+                    this->freeEntities.pop_back();
+                    return entity;
+                }
+                assertm(this->nextEntityIndex < EntityTraits::INDEX_MASK, "Too many live entities, raise EntityTraits::INDEX_BITS");
+                return EntityTraits::Combine(this->nextEntityIndex++, 0);
+            }
+
+            void AllocateEntities(Entity *entities, size_t count) {
+                std::lock_guard lock(this->entityMutex);
+                for (size_t i = 0; i < count; i++) {
+                    if (!this->freeEntities.empty()) {
+                        entities[i] = this->freeEntities.back();
+                        this->freeEntities.pop_back();
+                    } else {
+                        assertm(this->nextEntityIndex < EntityTraits::INDEX_MASK, "Too many live entities, raise EntityTraits::INDEX_BITS");
+                        entities[i] = EntityTraits::Combine(this->nextEntityIndex++, 0);
+                    }
+                }
+            }
+
+            void ReleaseEntity(Entity entity) {
+                std::lock_guard lock(this->entityMutex);
+                this->freeEntities.push_back(EntityTraits::Combine(EntityTraits::ToIndex(entity), EntityTraits::ToVersion(entity) + 1));
+            }
+
+            // Every component in the signature must have been registered
+            Archetype *GetArchetype(const Signature &signature) {
+                if (auto it = this->archetypeIndex.find(signature); it != this->archetypeIndex.end()) {
+                    return it->second;
+                }
+                std::vector<ComponentMeta> metas;
+                for (ComponentID id = 0; id < this->componentInfos.size(); id++) {
+                    if (signature.test(id)) {
+                        metas.push_back(this->componentInfos[id].meta);
+                    }
+                }
+                this->archetypes.push_back(std::make_unique<Archetype>(signature, metas));
+                auto result = this->archetypes.back().get();
+                result->index = this->archetypes.size() - 1;
+                this->archetypeIndex.emplace(signature, result);
+                for (auto &[mask, group] : this->groups) {
+                    if ((signature & mask) == mask) {
+                        group->archetypes.push_back(result);
+                    }
+                }
+                return result;
+            }
+
+            // Groups are created on first use, systems may ask for them concurrently
+            GroupInfo &GetGroup(const Signature &mask) {
+                std::lock_guard lock(this->groupMutex);
+                auto &group = this->groups[mask];
+                if (!group) {
+                    group = std::make_unique<GroupInfo>();
+                    group->mask = mask;
+                    for (auto &archetype : this->archetypes) {
+                        if ((archetype->GetSignature() & mask) == mask) {
+                            group->archetypes.push_back(archetype.get());
+                        }
+                    }
+                }
+                return *group;
+            }
+
+            // Archetype with the storage signature `target`, single component steps away from `from`
+            // are cached on both archetypes as graph edges
+            Archetype *GetArchetypeFor(Archetype *from, const Signature &target) {
+                auto diff = from->GetSignature() ^ target;
+                if (diff.none()) {
+                    return from;
+                }
+                if (diff.count() != 1) {
+                    return this->GetArchetype(target);
+                }
+                ComponentID id = 0;
+                while (!diff.test(id)) {
+                    id++;
+                }
+                auto adding = target.test(id);
+                auto &edges = adding ? from->addEdges : from->removeEdges;
+                if (auto it = edges.find(id); it != edges.end()) {
+                    return it->second;
+                }
+                auto to = this->GetArchetype(target);
+                edges[id] = to;
+                (adding ? to->removeEdges : to->addEdges)[id] = from;
+                return to;
+            }
+
+            // Moves the entity's row into another archetype, shared components are relocated,
+            // components missing in the target are destroyed and new ones are left uninitialized.
+            // The record's signature is left to the caller
+            size_t MoveEntity(Entity entity, Archetype *to) {
+                auto &record = this->Record(entity);
+                auto from = record.archetype;
+                auto row = to->Allocate(entity);
+                for (size_t c = 0; c < from->columns.size(); c++) {
+                    auto target = to->FindColumn(from->columns[c].id);
+                    if (target >= 0) {
+                        from->columns[c].meta.relocate(to->Get(target, row), from->Get(c, record.row));
+                        to->AddedTick(target, row) = from->AddedTick(c, record.row);
+                        to->ChangedTick(target, row) = from->ChangedTick(c, record.row);
+                    } else {
+                        from->columns[c].meta.destroy(from->Get(c, record.row));
+                    }
+                }
+                auto moved = from->Detach(record.row);
+                if (moved != EntityTraits::null) {
+                    this->Record(moved).row = record.row;
+                }
+                record.archetype = to;
+                record.row = row;
+                return row;
+            }
+
+            // Slot of the resource table, `resource` points to a T owned by the slot
+            struct ResourceInfo {
+                void *resource = nullptr;
+                using Destructor = void (*)(void *);
+                Destructor dtor = nullptr;
+                // Trivially copyable resources are part of World snapshots
+                size_t size = 0;
+                bool trivial = false;
+
+                ResourceInfo() = default;
+                ResourceInfo(const ResourceInfo &) = delete;
+                ResourceInfo &operator=(const ResourceInfo &) = delete;
+
+                ResourceInfo(ResourceInfo &&other) noexcept
+                    : resource(other.resource), dtor(other.dtor), size(other.size), trivial(other.trivial) {
+                    other.resource = nullptr;
+                }
+
+                ~ResourceInfo() {
+                    this->Reset();
+                }
+
+                void Reset() {
+                    if (this->resource) {
+                        this->dtor(this->resource);
+                        this->resource = nullptr;
+                    }
+                }
+            };
+
+            struct SystemInfo {
+                UpdateSystem func;
+                SystemAccess access;
+                std::vector<size_t> dependents;
+                size_t dependencyCount = 0;
+                uint32_t lastRun = 0;
+                size_t profileSlot = 0;
+            };
+
+            // Indexed by resource id, ids are handed out densely on first use of a type
+            std::vector<ResourceInfo> resources;
+
+            // Replacing assigns in place, so references handed out by Resources::Get stay valid
+            template<typename T>
+            void PutResource(T &&resource) {
+                using Type = std::remove_cvref_t<T>;
+                auto index = IndexGetter<Resource>::Get<Type>();
+                if (index >= this->resources.size()) {
+                    this->resources.resize(index + 1);
+                }
+                auto &info = this->resources[index];
+                if (info.resource) {
+                    *((Type *) info.resource) = std::forward<T>(resource);
+                } else {
+                    info.resource = new Type(std::forward<T>(resource));
+                    info.dtor = [](void *elem) { delete (Type *) elem; };
+                    info.size = sizeof(Type);
+                    info.trivial = std::is_trivially_copyable_v<Type>;
+                }
+            }
+            std::vector<StartupSystem> startups;
+            std::vector<SystemInfo> updates;
+            // One per update system, kept across frames so their arenas are reused
+            std::vector<Commands> commandBuffers;
+            // Per-chunk or per-worker buffers of ParallelEach, one set per concurrent call
+            std::vector<std::vector<Commands>> parallelBuffers;
+            std::mutex parallelMutex;
+            std::unique_ptr<ThreadPool> pool;
+            std::mutex poolMutex;
+            std::atomic<uint32_t> changeTick = 0;
+
+            uint32_t NextTick() {
+                return ++this->changeTick;
+            }
+
+            struct ComponentObservers {
+                std::vector<Observer> onAdd;
+                std::vector<Observer> onRemove;
+                std::vector<Observer> onReplace;
+            };
+
+            // Indexed by component id, the masks tell which ids have any observer of the kind
+            std::vector<ComponentObservers> observers;
+            Signature observedAdd;
+            Signature observedRemove;
+            Signature observedReplace;
+
+            ComponentObservers &ObserversOf(ComponentID id) {
+                assertm(id < MAX_COMPONENT_TYPES, "Too many component types, raise MAX_COMPONENT_TYPES");
+                if (id >= this->observers.size()) {
+                    this->observers.resize(id + 1);
+                }
+                return this->observers[id];
+            }
+
+            std::vector<SystemInfo> renders;
+            std::vector<Commands> renderBuffers;
+            std::vector<size_t> startupSlots;
+            Profiler profiler;
+
+            struct PersistInfo {
+                std::string name;
+                // Null for types stored as raw columns
+                std::function<void(const void *, std::vector<std::byte> &)> write;
+                std::function<void(void *, std::span<const std::byte>, size_t &)> read;
+            };
+
+            // Indexed by component id, types without a name are not persisted
+            std::vector<PersistInfo> persisted;
+            Signature transient;
+
+            World &Persist(ComponentID id, const ComponentMeta &meta, const std::string &name,
+                           decltype(PersistInfo::write) write, decltype(PersistInfo::read) read) {
+                this->RegisterComponent(id, meta);
+                if (id >= this->persisted.size()) {
+                    this->persisted.resize(id + 1);
+                }
+                this->persisted[id] = PersistInfo { name, std::move(write), std::move(read) };
+                return *this;
+            }
+
+            bool IsPersisted(ComponentID id) const {
+                return id < this->persisted.size() && !this->persisted[id].name.empty();
+            }
+            size_t destroySlot;
+            size_t spawnSlot;
+            size_t changeSlot;
+            size_t observeSlot;
+            bool advancing = false;
+            float fixedStep = 0;
+            uint32_t maxTicks = 8;
+            float accumulator = 0;
+
+            void RunSystems(std::vector<Commands> &commandList);
+            void RunRenderSystems();
+            Time &GetTime();
+        };
+
+        inline constexpr size_t COMMAND_BLOCK_SIZE = 16 * 1024;
+
+        // Bump allocator backing a command buffer. Blocks are never moved or freed until the arena
+        // dies, Reset() only rewinds the cursor so a buffer reused every frame stops allocating
+        class CommandArena final {
+        public:
+            CommandArena() = default;
+            CommandArena(const CommandArena &) = delete;
+            CommandArena &operator=(const CommandArena &) = delete;
+
+            CommandArena(CommandArena &&other) noexcept : blocks(std::move(other.blocks)), current(other.current), offset(other.offset) {
+                other.blocks.clear();
+                other.Reset();
+            }
+
+            ~CommandArena() {
+                for (auto &block : this->blocks) {
+                    ::operator delete(block.data, std::align_val_t(ARCHETYPE_CHUNK_ALIGN));
+                }
+            }
+
+            void *Allocate(size_t size, size_t align) {
+                assertm(align <= ARCHETYPE_CHUNK_ALIGN, "Command payload alignment exceeds block alignment");
+                while (true) {
+                    if (this->current == this->blocks.size()) {
+                        auto blockSize = std::max(COMMAND_BLOCK_SIZE, size);
+                        auto data = (std::byte *) ::operator new(blockSize, std::align_val_t(ARCHETYPE_CHUNK_ALIGN));
+                        this->blocks.push_back(Block { data, blockSize });
+                    }
+                    auto &block = this->blocks[this->current];
+                    auto begin = (this->offset + align - 1) / align * align;
+                    if (begin + size <= block.size) {
+                        this->offset = begin + size;
+                        return block.data + begin;
+                    }
+                    this->current++;
+                    this->offset = 0;
+                }
+            }
+
+            template<typename T>
+            T *New(size_t count = 1) {
+                static_assert(std::is_trivially_destructible_v<T>, "Arena records are dropped without running destructors");
+                auto data = (T *) this->Allocate(sizeof(T) * count, alignof(T));
+                for (size_t i = 0; i < count; i++) {
+                    new (data + i) T();
+                }
+                return data;
+            }
+
+            void Reset() {
+                this->current = 0;
+                this->offset = 0;
+            }
+
+            // Takes over the used blocks of another arena, whatever was allocated from them stays valid.
+            // Spare blocks past the cursor go to `other` in exchange, so arenas merged every frame stop allocating
+            void Adopt(CommandArena &&other) {
+                auto used = std::min(other.current + 1, other.blocks.size());
+                auto spare = this->blocks.size() - std::min(this->current + 1, this->blocks.size());
+                auto swapped = std::min(used, spare);
+                std::swap_ranges(other.blocks.begin(), other.blocks.begin() + swapped, this->blocks.end() - swapped);
+                std::rotate(this->blocks.begin() + this->current, this->blocks.end() - swapped, this->blocks.end());
+                this->blocks.insert(this->blocks.begin() + this->current + swapped, other.blocks.begin() + swapped, other.blocks.begin() + used);
+                this->current += used;
+                other.blocks.erase(other.blocks.begin() + swapped, other.blocks.begin() + used);
+                other.Reset();
+            }
+
+        private:
+            struct Block {
+                std::byte *data;
+                size_t size;
+            };
+
+            std::vector<Block> blocks;
+            size_t current = 0;
+            size_t offset = 0;
+        };
+
+        // Reusable blueprint of an entity. Holds one prototype per component, instantiating it
+        // copies the prototypes straight into archetype storage
+        class Prefab final {
+        public:
+            friend class Commands;
+
+            template<typename ...ComponentTypes>
+            explicit Prefab(ComponentTypes &&...components) {
+                (this->Add(std::forward<ComponentTypes>(components)), ...);
+            }
+
+            Prefab(const Prefab &) = delete;
+            Prefab &operator=(const Prefab &) = delete;
+            Prefab(Prefab &&) noexcept = default;
+
+            ~Prefab() {
+                for (auto &part : this->parts) {
+                    if (!part.data) {
+                        continue;
+                    }
+                    part.meta->destroy(part.data);
+                    ::operator delete(part.data, std::align_val_t(part.meta->align));
+                }
+            }
+
+            // Adds a component, or replaces the prototype if the prefab already has one of that type
+            template<typename T>
+            Prefab &Add(T &&component) {
+                using Type = std::remove_cvref_t<T>;
+                static_assert(std::is_copy_constructible_v<Type>, "Prefab components must be copy constructible");
+                auto id = IndexGetter<Component>::Get<Type>();
+                if (this->signature.test(id)) {
+                    if constexpr (!std::is_empty_v<Type>) {
+                        auto it = std::find_if(this->parts.begin(), this->parts.end(), [&](const Part &part) { return part.id == id; });
+                        *((Type *) it->data) = std::forward<T>(component);
+                    }
+                    return *this;
+                }
+                // Tags only take part in the signature
+                void *data = nullptr;
+                if constexpr (!std::is_empty_v<Type>) {
+                    data = ::operator new(sizeof(Type), std::align_val_t(alignof(Type)));
+                    new (data) Type(std::forward<T>(component));
+                }
+                this->parts.push_back(Part { id, &ComponentMeta::Of<Type>(), data });
+                this->signature.set(id);
+                return *this;
+            }
+
+            template<typename T>
+            bool Has() const {
+                return this->signature.test(IndexGetter<Component>::Get<T>());
+            }
+
+            template<typename T>
+            T &Get() {
+                auto id = IndexGetter<Component>::Get<T>();
+                assertm(this->signature.test(id), "Prefab does not have the component");
+                if constexpr (std::is_empty_v<T>) {
+                    return TagInstance<T>();
+                } else {
+                    auto it = std::find_if(this->parts.begin(), this->parts.end(), [&](const Part &part) { return part.id == id; });
+                    return *((T *) it->data);
+                }
+            }
+
+        private:
+            struct Part {
+                ComponentID id;
+                const ComponentMeta *meta;
+                void *data;
+            };
+
+            std::vector<Part> parts;
+            Signature signature;
+        };
+
+        class Commands final {
+        public:
+            Commands(World &world) : world(world) {}
+            Commands(const Commands &) = delete;
+            Commands &operator=(const Commands &) = delete;
+
+            Commands(Commands &&other) noexcept
+                : world(other.world), arena(std::move(other.arena)),
+                  resourceChanges(other.resourceChanges), destroys(other.destroys), spawns(other.spawns), changes(other.changes),
+                  changeList(std::move(other.changeList)), changeGroups(std::move(other.changeGroups)),
+                  added(std::move(other.added)), removed(std::move(other.removed)), replaced(std::move(other.replaced)) {
+                other.resourceChanges = {};
+                other.destroys = {};
+                other.spawns = {};
+                other.changes = {};
+            }
+
+            // Components of commands that never got executed are still owned by the buffer
+            ~Commands() {
+                for (auto record = this->resourceChanges.head; record; record = record->next) {
+                    if (record->data) {
+                        record->drop(record->data);
+                    }
+                }
+                for (auto record = this->spawns.head; record; record = record->next) {
+                    for (uint32_t i = 0; i < record->componentCount; i++) {
+                        Drop(record->components[i]);
+                    }
+                }
+                for (auto record = this->changes.head; record; record = record->next) {
+                    Drop(record->component);
+                }
+            }
+
+            template<typename ...ComponentTypes>
+            Commands &Spawn(ComponentTypes &&...components) {
+                this->Spawned<ComponentTypes...>(std::forward<ComponentTypes>(components)...);
+                return *this;
+            }
+
+            template<typename ...ComponentTypes>
+            Entity Spawned(ComponentTypes &&...components) {
+                auto record = this->RecordSpawn(1, sizeof...(ComponentTypes));
+                if constexpr (sizeof...(ComponentTypes) != 0) {
+                    size_t i = 0;
+                    (this->RecordComponent(record->components[i++], record->signature, std::forward<ComponentTypes>(components)), ...);
+                }
+                return record->entity;
+            }
+
+            // Spawns `count` entities with copies of the given components in a single pass
+            template<typename ...ComponentTypes>
+            Commands &SpawnBatch(size_t count, ComponentTypes &&...components) {
+                this->SpawnBatchImpl(count, std::forward<ComponentTypes>(components)...);
+                return *this;
+            }
+
+            template<typename ...ComponentTypes>
+            std::vector<Entity> SpawnedBatch(size_t count, ComponentTypes &&...components) {
+                auto record = this->SpawnBatchImpl(count, std::forward<ComponentTypes>(components)...);
+                return record ? std::vector<Entity>(record->entities, record->entities + count) : std::vector<Entity> {};
+            }
+
+            // The prefab is copied while recording, it does not need to outlive the buffer
+            Commands &Instantiate(const Prefab &prefab, size_t count = 1) {
+                this->InstantiateImpl(prefab, count);
+                return *this;
+            }
+
+            Entity Instantiated(const Prefab &prefab) {
+                return this->InstantiateImpl(prefab, 1)->entity;
+            }
+
+            Commands &Destroy(Entity entity) {
+                auto record = this->arena.New<DestroyRecord>();
+                record->entity = entity;
+                this->destroys.Push(record);
+                return *this;
+            }
+
+            // Adds the component to a live entity, or replaces the one it already has
+            template<typename T>
+            Commands &Insert(Entity entity, T &&component) {
+                auto record = this->arena.New<ChangeRecord>();
+                record->entity = entity;
+                record->insert = true;
+                Signature unused;
+                this->RecordComponent(record->component, unused, std::forward<T>(component));
+                this->changes.Push(record);
+                return *this;
+            }
+
+            template<typename T>
+            Commands &Remove(Entity entity) {
+                auto record = this->arena.New<ChangeRecord>();
+                record->entity = entity;
+                record->insert = false;
+                record->component.id = IndexGetter<Component>::Get<std::remove_cvref_t<T>>();
+                this->changes.Push(record);
+                return *this;
+            }
+
+            // Moves the commands recorded in another buffer behind the ones recorded here
+            Commands &Append(Commands &&other) {
+                this->arena.Adopt(std::move(other.arena));
+                this->resourceChanges.Splice(other.resourceChanges);
+                this->destroys.Splice(other.destroys);
+                this->spawns.Splice(other.spawns);
+                this->changes.Splice(other.changes);
+                return *this;
+            }
+
+            // Like every other command the resource only shows up in the world once the buffer is
+            // executed, buffers filled on worker threads never touch the resource table
+            template<typename T>
+            Commands &SetResource(T &&resource) {
+                using Type = std::remove_cvref_t<T>;
+                auto record = this->arena.New<ResourceRecord>();
+                record->index = IndexGetter<Resource>::Get<Type>();
+                record->data = this->arena.Allocate(sizeof(Type), alignof(Type));
+                new (record->data) Type(std::forward<T>(resource));
+                record->set = [](World &world, void *data) {
+                    world.PutResource(std::move(*(Type *) data));
+                    ((Type *) data)->~Type();
+                };
+                record->drop = [](void *data) { ((Type *) data)->~Type(); };
+                this->resourceChanges.Push(record);
+                return *this;
+            }
+
+            template<typename T>
+            Commands &RemoveResource() {
+                auto record = this->arena.New<ResourceRecord>();
+                record->index = IndexGetter<Resource>::Get<T>();
+                this->resourceChanges.Push(record);
+                return *this;
+            }
+
+            // Plays the recorded commands back and empties the buffer. Destroys run first, then spawns,
+            // then inserts and removals, so entities spawned by the buffer can be changed by it as well
+            void Execute() {
+                auto &profiler = this->world.profiler;
+                auto start = ProfileClock::now();
+                for (auto record = this->resourceChanges.head; record; record = record->next) {
+                    this->ExecuteResource(*record);
+                }
+                if (this->world.observedRemove.any()) {
+                    for (auto record = this->destroys.head; record; record = record->next) {
+                        if (this->world.IsAlive(record->entity)) {
+                            this->removed.Push(this->world.Record(record->entity).signature & this->world.observedRemove, &record->entity, 1);
+                        }
+                    }
+                    this->removed.Notify(this->world, &ComponentObservers::onRemove, true);
+                }
+                for (auto record = this->destroys.head; record; record = record->next) {
+                    this->ExecuteDestroy(record->entity);
+                }
+                profiler.Record(this->world.destroySlot, start);
+
+                // Gets its own tick, so the changes are newer than the last run of every system
+                auto tick = this->world.NextTick();
+                start = ProfileClock::now();
+                Archetype *archetype = nullptr;
+                for (auto record = this->spawns.head; record; record = record->next) {
+                    archetype = this->ExecuteSpawn(*record, archetype, tick);
+                    this->added.Push(record->signature & this->world.observedAdd, record->entities, record->count);
+                }
+                profiler.Record(this->world.spawnSlot, start);
+                if (this->changes.head) {
+                    start = ProfileClock::now();
+                    this->ExecuteChanges(tick);
+                    profiler.Record(this->world.changeSlot, start);
+                }
+                start = ProfileClock::now();
+                this->added.Notify(this->world, &ComponentObservers::onAdd, false);
+                this->replaced.Notify(this->world, &ComponentObservers::onReplace, false);
+                profiler.Record(this->world.observeSlot, start);
+                this->resourceChanges = {};
+                this->destroys = {};
+                this->spawns = {};
+                this->changes = {};
+                this->arena.Reset();
+            }
+
+        private:
+            // Records live in the arena and are chained in recording order
+            template<typename T>
+            struct RecordList {
+                T *head = nullptr;
+                T *tail = nullptr;
+
+                void Push(T *record) {
+                    (this->tail ? this->tail->next : this->head) = record;
+                    this->tail = record;
+                }
+
+                void Splice(RecordList &other) {
+                    if (other.head) {
+                        (this->tail ? this->tail->next : this->head) = other.head;
+                        this->tail = other.tail;
+                    }
+                    other = {};
+                }
+            };
+
+            // Sets the resource held in `data`, or removes it when there is none
+            struct ResourceRecord {
+                ResourceRecord *next;
+                uint32_t index;
+                void *data;
+                // Moves `data` into the world and destroys it
+                void (*set)(World &world, void *data);
+                void (*drop)(void *data);
+            };
+
+            struct DestroyRecord {
+                DestroyRecord *next;
+                Entity entity;
+            };
+
+            // `data` points to a constructed component inside the arena
+            struct ComponentRecord {
+                ComponentID id;
+                const ComponentMeta *meta;
+                void *data;
+            };
+
+            // Spawns `count` entities sharing the same components, `entities` points to `entity`
+            // for single spawns. Batches copy the components into all rows but the last one,
+            // which receives the recorded component itself
+            struct SpawnRecord {
+                SpawnRecord *next;
+                Entity entity;
+                Entity *entities;
+                size_t count;
+                Signature signature;
+                uint32_t componentCount;
+                ComponentRecord *components;
+            };
+
+            // Insert or removal of a single component, `component.data` is null for removals and tags
+            struct ChangeRecord {
+                ChangeRecord *next;
+                Entity entity;
+                bool insert;
+                // Position in the buffer, assigned when the changes are executed
+                uint32_t sequence;
+                ComponentRecord component;
+            };
+
+            // The changes of one entity, [begin, end) of the sorted change list
+            struct ChangeGroup {
+                Entity entity;
+                Archetype *from;
+                Archetype *to;
+                Signature signature;
+                size_t begin;
+                size_t end;
+            };
+
+            World &world;
+            CommandArena arena;
+            RecordList<ResourceRecord> resourceChanges;
+            RecordList<DestroyRecord> destroys;
+            RecordList<SpawnRecord> spawns;
+            RecordList<ChangeRecord> changes;
+            // Scratch space of ExecuteChanges, kept to reuse the capacity
+            std::vector<ChangeRecord *> changeList;
+            std::vector<ChangeGroup> changeGroups;
+
+            using ComponentObservers = World::ComponentObservers;
+
+            // Entities waiting to be handed to the observers, per component type
+            struct ObserverBatch {
+                std::vector<std::vector<Entity>> entities;
+                Signature pending;
+
+                void Push(const Signature &ids, const Entity *first, size_t count) {
+                    if (ids.none()) {
+                        return;
+                    }
+                    for (ComponentID id = 0; id < MAX_COMPONENT_TYPES; id++) {
+                        if (!ids.test(id)) {
+                            continue;
+                        }
+                        if (id >= this->entities.size()) {
+                            this->entities.resize(id + 1);
+                        }
+                        this->entities[id].insert(this->entities[id].end(), first, first + count);
+                    }
+                    this->pending |= ids;
+                }
+
+                // `unique` drops repeated entities, such as an entity destroyed twice by the same buffer
+                void Notify(World &world, std::vector<World::Observer> ComponentObservers::*kind, bool unique) {
+                    for (ComponentID id = 0; this->pending.any() && id < this->entities.size(); id++) {
+                        if (!this->pending.test(id)) {
+                            continue;
+                        }
+                        this->pending.reset(id);
+                        auto &batch = this->entities[id];
+                        if (unique) {
+                            std::sort(batch.begin(), batch.end());
+                            batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+                        }
+                        for (auto &observer : world.observers[id].*kind) {
+                            observer(world, batch);
+                        }
+                        batch.clear();
+                    }
+                }
+            };
+
+            ObserverBatch added;
+            ObserverBatch removed;
+            ObserverBatch replaced;
+
+            SpawnRecord *RecordSpawn(size_t count, size_t componentCount) {
+                auto record = this->arena.New<SpawnRecord>();
+                record->count = count;
+                if (count == 1) {
+                    record->entities = &record->entity;
+                    record->entity = this->world.AllocateEntity();
+                } else {
+                    record->entities = this->arena.New<Entity>(count);
+                    this->world.AllocateEntities(record->entities, count);
+                    record->entity = record->entities[0];
+                }
+                record->componentCount = (uint32_t) componentCount;
+                if (componentCount != 0) {
+                    record->components = this->arena.New<ComponentRecord>(componentCount);
+                }
+                this->spawns.Push(record);
+                return record;
+            }
+
+            template<typename ...ComponentTypes>
+            SpawnRecord *SpawnBatchImpl(size_t count, ComponentTypes &&...components) {
+                static_assert((std::is_copy_constructible_v<std::remove_cvref_t<ComponentTypes>> && ...), "Batched components must be copy constructible");
+                if (count == 0) {
+                    return nullptr;
+                }
+                auto record = this->RecordSpawn(count, sizeof...(ComponentTypes));
+                if constexpr (sizeof...(ComponentTypes) != 0) {
+                    size_t i = 0;
+                    (this->RecordComponent(record->components[i++], record->signature, std::forward<ComponentTypes>(components)), ...);
+                }
+                return record;
+            }
+
+            SpawnRecord *InstantiateImpl(const Prefab &prefab, size_t count) {
+                if (count == 0) {
+                    return nullptr;
+                }
+                auto record = this->RecordSpawn(count, prefab.parts.size());
+                record->signature = prefab.signature;
+                for (size_t i = 0; i < prefab.parts.size(); i++) {
+                    auto &part = prefab.parts[i];
+                    auto &component = record->components[i];
+                    component.id = part.id;
+                    component.meta = part.meta;
+                    if (part.data) {
+                        component.data = this->arena.Allocate(part.meta->size, part.meta->align);
+                        part.meta->fill(component.data, part.data, 1);
+                    }
+                }
+                return record;
+            }
+
+            template<typename T>
+            void RecordComponent(ComponentRecord &record, Signature &signature, T &&component) {
+                using Type = std::remove_cvref_t<T>;
+                record.id = IndexGetter<Component>::Get<Type>();
+                record.meta = &ComponentMeta::Of<Type>();
+                // Tags are never stored, so they record no payload
+                if constexpr (!std::is_empty_v<Type>) {
+                    record.data = this->arena.Allocate(sizeof(Type), alignof(Type));
+                    new (record.data) Type(std::forward<T>(component));
+                }
+                assertm(!signature.test(record.id), "Duplicated component type in spawn");
+                signature.set(record.id);
+            }
+
+            // `last` is the archetype of the previous spawn, consecutive spawns of the same
+            // component set skip the archetype lookup
+            Archetype *ExecuteSpawn(SpawnRecord &record, Archetype *last, uint32_t tick) {
+                for (uint32_t i = 0; i < record.componentCount; i++) {
+                    this->world.RegisterComponent(record.components[i].id, *record.components[i].meta);
+                }
+
+                auto storage = this->world.StorageSignature(record.signature);
+                auto archetype = last && last->GetSignature() == storage ? last : this->world.GetArchetype(storage);
+                auto first = archetype->Allocate(record.entities, record.count);
+                auto lastRow = first + record.count - 1;
+                for (uint32_t i = 0; i < record.componentCount; i++) {
+                    auto &component = record.components[i];
+                    auto column = archetype->FindColumn(component.id);
+                    if (column >= 0) {
+                        if (record.count > 1) {
+                            archetype->Fill(column, first, record.count - 1, component.data);
+                        }
+                        component.meta->relocate(archetype->Get(column, lastRow), component.data);
+                        archetype->Stamp(column, first, record.count, tick);
+                    }
+
+                    auto &info = this->world.componentInfos[component.id];
+                    info.sparseSet.Reserve(info.sparseSet.Size() + record.count);
+                    for (size_t e = 0; e < record.count; e++) {
+                        info.AddEntity(record.entities[e]);
+                    }
+                }
+
+                uint32_t maxIndex = 0;
+                for (size_t e = 0; e < record.count; e++) {
+                    maxIndex = std::max(maxIndex, EntityTraits::ToIndex(record.entities[e]));
+                }
+                if (maxIndex >= this->world.entities.size()) {
+                    this->world.entities.resize(maxIndex + 1);
+                }
+                for (size_t e = 0; e < record.count; e++) {
+                    this->world.entities[EntityTraits::ToIndex(record.entities[e])] = World::EntityRecord { record.signature, archetype, first + e, record.entities[e] };
+                }
+                return archetype;
+            }
+
+            void ExecuteDestroy(Entity entity) {
+                if (this->world.IsAlive(entity)) {
+                    auto &record = this->world.Record(entity);
+                    auto archetype = record.archetype;
+                    auto row = record.row;
+                    for (ComponentID id = 0; id < this->world.componentInfos.size(); id++) {
+                        if (record.signature.test(id)) {
+                            this->world.componentInfos[id].RemoveEntity(entity);
+                        }
+                    }
+                    record = World::EntityRecord {};
+                    auto moved = archetype->Remove(row);
+                    if (moved != EntityTraits::null) {
+                        this->world.Record(moved).row = row;
+                    }
+                    this->world.ReleaseEntity(entity);
+                }
+            }
+
+            // Folds the changes of every entity into its final signature, so each entity moves at most once,
+            // and applies the moves grouped by (source, target) archetype. Changes that keep the archetype,
+            // such as replacing a component or toggling a tag, are applied in place
+            void ExecuteChanges(uint32_t tick) {
+                this->changeList.clear();
+                uint32_t sequence = 0;
+                for (auto record = this->changes.head; record; record = record->next) {
+                    record->sequence = sequence++;
+                    this->changeList.push_back(record);
+                }
+                // Sorts in place, the recording order breaks ties so later changes of an entity still win
+                std::sort(this->changeList.begin(), this->changeList.end(), [](const ChangeRecord *a, const ChangeRecord *b) {
+                    return a->entity != b->entity ? a->entity < b->entity : a->sequence < b->sequence;
+                });
+
+                this->changeGroups.clear();
+                for (size_t begin = 0, end = 0; begin < this->changeList.size(); begin = end) {
+                    auto entity = this->changeList[begin]->entity;
+                    while (end < this->changeList.size() && this->changeList[end]->entity == entity) {
+                        end++;
+                    }
+                    if (!this->world.IsAlive(entity)) {
+                        this->DiscardChanges(begin, end);
+                        continue;
+                    }
+                    auto &record = this->world.Record(entity);
+                    auto signature = record.signature;
+                    for (auto i = begin; i < end; i++) {
+                        auto &component = this->changeList[i]->component;
+                        if (this->changeList[i]->insert) {
+                            this->world.RegisterComponent(component.id, *component.meta);
+                            signature.set(component.id);
+                        } else {
+                            signature.reset(component.id);
+                        }
+                    }
+                    auto to = this->world.GetArchetypeFor(record.archetype, this->world.StorageSignature(signature));
+                    this->changeGroups.push_back(ChangeGroup { entity, record.archetype, to, signature, begin, end });
+                }
+                std::sort(this->changeGroups.begin(), this->changeGroups.end(), [](const ChangeGroup &a, const ChangeGroup &b) {
+                    return a.from != b.from ? a.from < b.from : a.to < b.to;
+                });
+
+                if (this->world.observedRemove.any()) {
+                    for (auto &group : this->changeGroups) {
+                        auto lost = this->world.Record(group.entity).signature & ~group.signature;
+                        this->removed.Push(lost & this->world.observedRemove, &group.entity, 1);
+                    }
+                    this->removed.Notify(this->world, &ComponentObservers::onRemove, false);
+                }
+
+                for (auto &group : this->changeGroups) {
+                    this->ApplyChanges(group, tick);
+                }
+            }
+
+            void ApplyChanges(const ChangeGroup &group, uint32_t tick) {
+                auto &record = this->world.Record(group.entity);
+                auto previous = record.signature;
+                if (group.to != group.from) {
+                    this->world.MoveEntity(group.entity, group.to);
+                }
+
+                // Only the last change of a component type counts
+                Signature applied;
+                Signature replacedIds;
+                for (auto i = group.end; i-- > group.begin;) {
+                    auto change = this->changeList[i];
+                    auto &component = change->component;
+                    if (applied.test(component.id)) {
+                        Drop(component);
+                        continue;
+                    }
+                    applied.set(component.id);
+                    if (!change->insert) {
+                        continue;
+                    }
+
+                    auto column = group.to->FindColumn(component.id);
+                    if (column < 0) {
+                        continue;
+                    }
+                    auto target = group.to->Get(column, record.row);
+                    if (previous.test(component.id)) {
+                        component.meta->destroy(target);
+                        component.meta->relocate(target, component.data);
+                        group.to->ChangedTick(column, record.row) = tick;
+                        replacedIds.set(component.id);
+                    } else {
+                        component.meta->relocate(target, component.data);
+                        group.to->Stamp(column, record.row, 1, tick);
+                    }
+                }
+
+                auto diff = previous ^ group.signature;
+                for (ComponentID id = 0; id < this->world.componentInfos.size(); id++) {
+                    if (!diff.test(id)) {
+                        continue;
+                    }
+                    if (group.signature.test(id)) {
+                        this->world.componentInfos[id].AddEntity(group.entity);
+                    } else {
+                        this->world.componentInfos[id].RemoveEntity(group.entity);
+                    }
+                }
+                record.signature = group.signature;
+                this->added.Push(diff & group.signature & this->world.observedAdd, &group.entity, 1);
+                this->replaced.Push(replacedIds & this->world.observedReplace, &group.entity, 1);
+            }
+
+            void DiscardChanges(size_t begin, size_t end) {
+                for (auto i = begin; i < end; i++) {
+                    Drop(this->changeList[i]->component);
+                }
+            }
+
+            static void Drop(ComponentRecord &component) {
+                if (component.data) {
+                    component.meta->destroy(component.data);
+                }
+            }
+
+            void ExecuteResource(ResourceRecord &record) {
+                if (record.data) {
+                    record.set(this->world, record.data);
+                    record.data = nullptr;
+                } else if (record.index < this->world.resources.size()) {
+                    this->world.resources[record.index].Reset();
+                }
+            }
+        };
+
+        class Resources final {
+        public:
+            Resources(World &world) : world(world) {}
+
+            template<typename T>
+            bool Has() const {
+                auto index = IndexGetter<Resource>::Get<T>();
+                return index < this->world.resources.size() && this->world.resources[index].resource;
+            }
+
+            // The reference stays valid until the resource is removed, replacing it assigns in place
+            template<typename T>
+            T &Get() {
+                auto index = IndexGetter<Resource>::Get<T>();
+                assertm(index < this->world.resources.size() && this->world.resources[index].resource, "Resource does not exist");
+                return *((T *) this->world.resources[index].resource);
+            }
+        private:
+            World &world;
+        };
+
+        struct ParallelOptions {
+            // Number of consecutive entities of the driving set handed to a single job
+            size_t chunkSize = 2048;
+            // Keeps one command buffer per chunk and merges them in chunk order, so the recorded
+            // commands do not depend on the thread count or on which worker ran which chunk. Spawned
+            // entities still take their handles from the shared free list as the workers get to them,
+            // so handles, and commands naming them, are only stable when the body does not spawn
+            bool deterministic = false;
+        };
+
+        inline constexpr size_t MAX_VIEW_FILTERS = 4;
+
+        // Typed view over every entity that has all the given components. Iteration is driven by the
+        // smallest participating sparse set and references are resolved from the entity location table,
+        // so walking a view neither allocates nor hashes per entity.
+        // Non-const components are marked as changed for every entity visited, `const T` reads are not
+        template<typename ...Components>
+        class View final {
+        public:
+            friend class Querier;
+
+            static_assert(sizeof...(Components) != 0, "View needs at least one component type");
+
+            // Changes are reported relative to `lastRun`, changes made through the view are stamped `thisRun`
+            View(World &world, uint32_t lastRun, uint32_t thisRun) : world(world), lastRun(lastRun), thisRun(thisRun) {
+                ComponentID ids[] = { IndexGetter<Component>::Get<std::remove_const_t<Components>>()... };
+                for (size_t i = 0; i < sizeof...(Components); i++) {
+                    this->ids[i] = ids[i];
+                    this->Require(ids[i]);
+                }
+            }
+
+            View(World &world) : View(world, 0, world.NextTick()) {}
+
+            // Only yields entities that also have T, without fetching it
+            template<typename T>
+            View &With() {
+                this->Require(IndexGetter<Component>::Get<std::remove_const_t<T>>());
+                return *this;
+            }
+
+            // Skips entities that have T
+            template<typename T>
+            View &Without() {
+                this->excluded.set(IndexGetter<Component>::Get<std::remove_const_t<T>>());
+                return *this;
+            }
+
+            // Only yields entities whose T has been inserted since the querying system last ran
+            template<typename T>
+            View &Added() {
+                static_assert(!std::is_empty_v<T>, "Tags carry no change ticks");
+                return this->Filter(IndexGetter<Component>::Get<std::remove_const_t<T>>(), true);
+            }
+
+            // Only yields entities whose T has been inserted or mutably accessed since the querying system last ran
+            template<typename T>
+            View &Changed() {
+                static_assert(!std::is_empty_v<T>, "Tags carry no change ticks");
+                return this->Filter(IndexGetter<Component>::Get<std::remove_const_t<T>>(), false);
+            }
+
+            // Upper bound of the number of entities in the view
+            size_t SizeHint() const {
+                return this->driver ? this->driver->Size() : 0;
+            }
+
+            // func(Entity, Components &...) or func(Components &...)
+            template<typename Func>
+            void Each(Func &&func) {
+                this->EachImpl(0, this->SizeHint(), [&](Entity entity, Components &...components) {
+                    if constexpr (std::is_invocable_v<Func &, Entity, Components &...>) {
+                        func(entity, components...);
+                    } else {
+                        func(components...);
+                    }
+                });
+            }
+
+            // Splits the driving set into chunks and runs them on the world's thread pool.
+            // func(Commands &, Entity, Components &...) records into a per-thread (or per-chunk when
+            // deterministic) buffer, the buffers are appended to `commands` once every chunk is done
+            template<typename Func>
+            void ParallelEach(Commands &commands, Func &&func, const ParallelOptions &options = {}) {
+                auto size = this->SizeHint();
+                if (size == 0) {
+                    return;
+                }
+                auto chunkSize = std::max<size_t>(1, options.chunkSize);
+                auto chunkCount = (size + chunkSize - 1) / chunkSize;
+                auto &pool = this->world.GetPool();
+
+                // Buffer sets are kept by the world, systems calling this side by side take different ones
+                std::vector<Commands> buffers;
+                {
+                    std::lock_guard lock(this->world.parallelMutex);
+                    if (!this->world.parallelBuffers.empty()) {
+                        buffers = std::move(this->world.parallelBuffers.back());
+                        this->world.parallelBuffers.pop_back();
+                    }
+                }
+                auto bufferCount = options.deterministic ? chunkCount : pool.GetWorkerCount() + 1;
+                while (buffers.size() < bufferCount) {
+                    buffers.emplace_back(this->world);
+                }
+
+                pool.ParallelFor(chunkCount, [&](size_t chunk) {
+                    auto &buffer = options.deterministic ? buffers[chunk] : buffers[pool.CurrentWorkerIndex() + 1];
+                    this->EachImpl(chunk * chunkSize, std::min(size, (chunk + 1) * chunkSize), [&](Entity entity, Components &...components) {
+                        if constexpr (std::is_invocable_v<Func &, Commands &, Entity, Components &...>) {
+                            func(buffer, entity, components...);
+                        } else if constexpr (std::is_invocable_v<Func &, Entity, Components &...>) {
+                            func(entity, components...);
+                        } else {
+                            func(components...);
+                        }
+                    });
+                });
+
+                for (size_t i = 0; i < bufferCount; i++) {
+                    commands.Append(std::move(buffers[i]));
+                }
+                std::lock_guard lock(this->world.parallelMutex);
+                this->world.parallelBuffers.push_back(std::move(buffers));
+            }
+
+        private:
+            struct TickFilter {
+                ComponentID id;
+                bool added;
+            };
+
+            World &world;
+            std::array<ComponentID, sizeof...(Components)> ids;
+            Signature mask;
+            Signature excluded;
+            SparseSet<Entity, 32> *driver = nullptr;
+            bool empty = false;
+            uint32_t lastRun;
+            uint32_t thisRun;
+            std::array<TickFilter, MAX_VIEW_FILTERS> filters;
+            size_t filterCount = 0;
+
+            void Require(ComponentID id) {
+                auto info = this->world.FindComponent(id);
+                this->mask.set(id);
+                if (!info) {
+                    this->driver = nullptr;
+                    this->empty = true;
+                } else if (!this->empty && (!this->driver || info->sparseSet.Size() < this->driver->Size())) {
+                    this->driver = &info->sparseSet;
+                }
+            }
+
+            View &Filter(ComponentID id, bool added) {
+                assertm(this->filterCount < MAX_VIEW_FILTERS, "Too many change filters on a view");
+                this->filters[this->filterCount++] = TickFilter { id, added };
+                this->Require(id);
+                return *this;
+            }
+
+            bool Accept(Entity entity) const {
+                auto &signature = this->world.Record(entity).signature;
+                return (signature & this->mask) == this->mask && (signature & this->excluded).none();
+            }
+
+            template<typename T>
+            void Mark(Archetype *archetype, int column, size_t row) const {
+                if constexpr (!std::is_const_v<T> && !std::is_empty_v<T>) {
+                    archetype->ChangedTick(column, row) = this->thisRun;
+                }
+            }
+
+            bool PassFilters(Archetype *archetype, size_t row, const std::array<int, MAX_VIEW_FILTERS> &columns) const {
+                for (size_t f = 0; f < this->filterCount; f++) {
+                    auto tick = this->filters[f].added ? archetype->AddedTick(columns[f], row) : archetype->ChangedTick(columns[f], row);
+                    if (!IsNewerTick(tick, this->lastRun, this->thisRun)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            template<typename Func>
+            void EachEntity(Func &&func) {
+                if (!this->driver) {
+                    return;
+                }
+                for (auto entity : *this->driver) {
+                    if (this->Accept(entity)) {
+                        func(entity);
+                    }
+                }
+            }
+
+            // Calls func(Entity, Components &...) for the accepted entities in [begin, end) of the driving set
+            template<typename Func>
+            void EachImpl(size_t begin, size_t end, Func &&func) {
+                this->EachImpl(begin, end, func, std::index_sequence_for<Components...> {});
+            }
+
+            template<typename Func, size_t ...I>
+            void EachImpl(size_t begin, size_t end, Func &func, std::index_sequence<I...>) {
+                if (!this->driver) {
+                    return;
+                }
+                // Views over tags only are a sparse set intersection, no archetype is looked at
+                if constexpr ((std::is_empty_v<Components> && ...)) {
+                    if (this->filterCount == 0) {
+                        for (size_t i = begin; i < end; i++) {
+                            auto entity = (*this->driver)[i];
+                            if (this->Accept(entity)) {
+                                func(entity, TagInstance<Components>()...);
+                            }
+                        }
+                        return;
+                    }
+                }
+                // Column indexes only change when the archetype does
+                Archetype *archetype = nullptr;
+                std::array<int, sizeof...(Components)> columns {};
+                std::array<int, MAX_VIEW_FILTERS> filterColumns {};
+                for (size_t i = begin; i < end; i++) {
+                    auto entity = (*this->driver)[i];
+                    if (!this->Accept(entity)) {
+                        continue;
+                    }
+                    auto &record = this->world.Record(entity);
+                    if (record.archetype != archetype) {
+                        archetype = record.archetype;
+                        columns = { archetype->FindColumn(this->ids[I])... };
+                        for (size_t f = 0; f < this->filterCount; f++) {
+                            filterColumns[f] = archetype->FindColumn(this->filters[f].id);
+                        }
+                    }
+                    if (this->filterCount != 0 && !this->PassFilters(archetype, record.row, filterColumns)) {
+                        continue;
+                    }
+                    (this->template Mark<Components>(archetype, columns[I], record.row), ...);
+                    func(entity, archetype->template Fetch<Components>(columns[I], record.row)...);
+                }
+            }
+        };
+
+        // Components that are iterated together. The group keeps the list of archetypes holding all of
+        // them, and archetypes store every component of an entity in the same chunk row, so the group
+        // is walked as parallel arrays, chunk by chunk, without any per-entity membership check.
+        // Non-const components are marked as changed for every chunk visited
+        template<typename ...Components>
+        class Group final {
+        public:
+            static_assert(sizeof...(Components) != 0, "Group needs at least one component type");
+            static_assert((!std::is_empty_v<Components> && ...), "Tags are not stored in chunks");
+
+            Group(World &world, uint32_t thisRun) : info(world.GetGroup(Mask())), thisRun(thisRun) {}
+
+            static Signature Mask() {
+                Signature mask;
+                (mask.set(IndexGetter<Component>::Get<std::remove_const_t<Components>>()), ...);
+                return mask;
+            }
+
+            size_t Size() const {
+                size_t size = 0;
+                for (auto archetype : this->info.archetypes) {
+                    size += archetype->Size();
+                }
+                return size;
+            }
+
+            // func(size_t count, Entity *, Components *...), the arrays of one chunk line up index by index
+            template<typename Func>
+            void EachChunk(Func &&func) {
+                this->EachChunkImpl(func, std::index_sequence_for<Components...> {});
+            }
+
+            // func(Entity, Components &...) or func(Components &...)
+            template<typename Func>
+            void Each(Func &&func) {
+                this->EachChunk([&](size_t count, Entity *entities, Components *...columns) {
+                    for (size_t i = 0; i < count; i++) {
+                        if constexpr (std::is_invocable_v<Func &, Entity, Components &...>) {
+                            func(entities[i], columns[i]...);
+                        } else {
+                            func(columns[i]...);
+                        }
+                    }
+                });
+            }
+
+        private:
+            World::GroupInfo &info;
+            uint32_t thisRun;
+
+            template<typename Func, size_t ...I>
+            void EachChunkImpl(Func &func, std::index_sequence<I...>) {
+                for (auto archetype : this->info.archetypes) {
+                    if (archetype->Size() == 0) {
+                        continue;
+                    }
+                    std::array<int, sizeof...(Components)> columns = {
+                        archetype->FindColumn(IndexGetter<Component>::Get<std::remove_const_t<Components>>())...
+                    };
+                    for (size_t chunk = 0; chunk < archetype->GetChunkCount(); chunk++) {
+                        auto count = archetype->GetChunkSize(chunk);
+                        (this->template Mark<Components>(archetype, columns[I], chunk, count), ...);
+                        func(count, archetype->Entities(chunk), (Components *) archetype->ColumnData(columns[I], chunk)...);
+                    }
+                }
+            }
+
+            template<typename T>
+            void Mark(Archetype *archetype, int column, size_t chunk, size_t count) const {
+                if constexpr (!std::is_const_v<T>) {
+                    std::fill_n(archetype->ChangedTicks(column, chunk), count, this->thisRun);
+                }
+            }
+        };
+
+        // Systems get a querier carrying the tick of their previous run and their access, which non-const
+        // fetches are checked against. A querier created anywhere else reports every component as
+        // added/changed and marks with a fresh tick
+        class Querier final {
+        public:
+            Querier(World &world) : world(world), lastRun(0), thisRun(world.NextTick()), access(nullptr) {}
+            Querier(World &world, uint32_t lastRun, uint32_t thisRun, const SystemAccess *access = nullptr)
+                : world(world), lastRun(lastRun), thisRun(thisRun), access(access) {}
+
+            template<typename ...Components>
+            std::vector<Entity> Query() {
+                std::vector<Entity> entities;
+                auto view = this->View<Components...>();
+                entities.reserve(view.SizeHint());
+                view.EachEntity([&](Entity entity) {
+                    entities.push_back(entity);
+                });
+                return entities;
+            }
+
+            template<typename ...Components>
+            ecs::View<Components...> View() {
+                this->CheckWrites<Components...>();
+                return ecs::View<Components...>(world, this->lastRun, this->thisRun);
+            }
+
+            template<typename ...Components, typename Func>
+            void Each(Func &&func) {
+                this->View<Components...>().Each(std::forward<Func>(func));
+            }
+
+            template<typename ...Components, typename Func>
+            void ParallelEach(Commands &commands, Func &&func, const ParallelOptions &options = {}) {
+                this->View<Components...>().ParallelEach(commands, std::forward<Func>(func), options);
+            }
+
+            template<typename ...Components>
+            ecs::Group<Components...> Group() {
+                this->CheckWrites<Components...>();
+                return ecs::Group<Components...>(world, this->thisRun);
+            }
+
+            // Walks every chunk whose archetype has all the given components,
+            // the callback receives a ChunkView to fetch the component arrays from
+            template<typename ...Components, typename Func>
+            void ForEachChunk(Func &&func) {
+                auto &group = world.GetGroup(ecs::Group<Components...>::Mask());
+                for (auto archetype : group.archetypes) {
+                    if (archetype->Size() == 0) {
+                        continue;
+                    }
+                    for (size_t chunk = 0; chunk < archetype->GetChunkCount(); chunk++) {
+                        func(ChunkView(*archetype, chunk, this->thisRun, this->access));
+                    }
+                }
+            }
+
+            bool IsAlive(Entity entity) const {
+                return world.IsAlive(entity);
+            }
+
+            template<typename T>
+            bool Has(Entity entity) {
+                auto index = IndexGetter<Component>::Get<std::remove_const_t<T>>();
+                return world.IsAlive(entity) && world.Record(entity).signature.test(index);
+            }
+
+            // Get<const T> reads without marking the component as changed
+            template<typename T>
+            T &Get(Entity entity) {
+                auto index = IndexGetter<Component>::Get<std::remove_const_t<T>>();
+                assertm(world.IsAlive(entity), "Stale entity handle");
+                auto &record = world.Record(entity);
+                assertm(record.signature.test(index), "Entity does not have the component");
+                auto column = record.archetype->FindColumn(index);
+                if constexpr (!std::is_const_v<T> && !std::is_empty_v<T>) {
+                    this->CheckWrites<T>();
+                    record.archetype->ChangedTick(column, record.row) = this->thisRun;
+                }
+                return record.archetype->template Fetch<T>(column, record.row);
+            }
+
+            template<typename T>
+            bool IsAdded(Entity entity) {
+                return this->IsNewer<T>(entity, true);
+            }
+
+            template<typename T>
+            bool IsChanged(Entity entity) {
+                return this->IsNewer<T>(entity, false);
+            }
+
+        private:
+            World &world;
+            uint32_t lastRun;
+            uint32_t thisRun;
+            const SystemAccess *access;
+
+            template<typename ...Components>
+            void CheckWrites() const {
+                if (!this->access) {
+                    return;
                 }
+                (assertm(std::is_const_v<Components> || std::is_empty_v<Components> || this->access->Writes(IndexGetter<Component>::Get<Components>()),
+                    "Non-const fetch of a component the system does not write"), ...);
+            }
+
+            template<typename T>
+            bool IsNewer(Entity entity, bool added) {
+                static_assert(!std::is_empty_v<T>, "Tags carry no change ticks");
+                auto index = IndexGetter<Component>::Get<std::remove_const_t<T>>();
+                if (!this->Has<T>(entity)) {
+                    return false;
+                }
+                auto &record = world.Record(entity);
+                auto column = record.archetype->FindColumn(index);
+                auto tick = added ? record.archetype->AddedTick(column, record.row) : record.archetype->ChangedTick(column, record.row);
+                return IsNewerTick(tick, this->lastRun, this->thisRun);
             }
         };
 
         inline void World::Startup() {
             std::vector<Commands> commandList;
-            for (auto sys : this->startups) {
-                Commands commands(*this);
-                sys(commands);
-                commandList.push_back(commands);
+            commandList.reserve(this->startups.size());
+            for (size_t i = 0; i < this->startups.size(); i++) {
+                commandList.emplace_back(*this);
+                auto start = ProfileClock::now();
+                this->startups[i](commandList.back());
+                this->profiler.Record(this->startupSlots[i], start);
             }
 
             for (auto &command : commandList) {
                 command.Execute();
             }
+            this->profiler.EndFrame();
         }
 
         inline void World::Update() {
-            std::vector<Commands> commandList;
-            for (auto sys : this->updates) {
-                Commands commands(*this);
-                sys(commands, Querier(*this), Resources(*this), events);
-                commandList.push_back(commands);
+            while (this->commandBuffers.size() < this->updates.size()) {
+                this->commandBuffers.emplace_back(*this);
             }
-            events.RemoveOldEvents();
-            events.AddAllEvents();
+            this->RunSystems(this->commandBuffers);
+            this->events.Swap();
 
-            for (auto &command : commandList) {
+            for (auto &command : this->commandBuffers) {
                 command.Execute();
             }
+            for (auto &archetype : this->archetypes) {
+                archetype->Trim();
+            }
+            if (!this->advancing) {
+                this->profiler.EndFrame();
+            }
         }
 
-        template<typename T>
-        World &World::SetResource(T &&resource) {
-            Commands command(*this);
-            command.SetResource(std::forward<T>(resource));
-            return *this;
+        inline uint32_t World::Advance(float frameTime) {
+            // All the updates of the call make up one profiler frame
+            this->advancing = true;
+            uint32_t ticks = 0;
+            if (this->fixedStep <= 0) {
+                auto &time = this->GetTime();
+                time.delta = frameTime;
+                time.alpha = 1;
+                time.ticks++;
+                this->Update();
+                ticks = 1;
+            } else {
+                this->accumulator += frameTime;
+                while (this->accumulator >= this->fixedStep && ticks < this->maxTicks) {
+                    auto &time = this->GetTime();
+                    time.delta = this->fixedStep;
+                    time.ticks++;
+                    this->Update();
+                    this->accumulator -= this->fixedStep;
+                    ticks++;
+                }
+                // A frame too slow to catch up with drops the time it could not simulate, otherwise
+                // every following frame would have even more updates to run
+                if (this->accumulator >= this->fixedStep) {
+                    this->accumulator = std::fmod(this->accumulator, this->fixedStep);
+                }
+                this->GetTime().alpha = this->accumulator / this->fixedStep;
+            }
+            this->RunRenderSystems();
+            this->advancing = false;
+            this->profiler.EndFrame();
+            return ticks;
         }
 
+        inline void World::RunRenderSystems() {
+            while (this->renderBuffers.size() < this->renders.size()) {
+                this->renderBuffers.emplace_back(*this);
+            }
+            for (size_t i = 0; i < this->renders.size(); i++) {
+                auto &info = this->renders[i];
+                auto thisRun = this->NextTick();
+                auto start = ProfileClock::now();
+                info.func(this->renderBuffers[i], Querier(*this, info.lastRun, thisRun), Resources(*this), this->events);
+                this->profiler.Record(info.profileSlot, start);
+                info.lastRun = thisRun;
+            }
+            for (size_t i = 0; i < this->renders.size(); i++) {
+                this->renderBuffers[i].Execute();
+            }
+        }
 
-        template<typename T>
-        auto Events::Reader() {
-            return EventReader<T>();
+        // Fetched again for every use, since systems may replace or remove it
+        inline Time &World::GetTime() {
+            Resources resources(*this);
+            if (!resources.Has<Time>()) {
+                this->SetResource(Time {});
+            }
+            return resources.Get<Time>();
         }
 
-        template<typename T>
-        auto Events::Writer() {
-            return EventWriter<T> {*this};
+        inline void World::RunSystems(std::vector<Commands> &commandList) {
+            auto run = [&](size_t index) {
+                auto &info = this->updates[index];
+                auto thisRun = this->NextTick();
+                auto start = ProfileClock::now();
+                info.func(commandList[index], Querier(*this, info.lastRun, thisRun, &info.access), Resources(*this), this->events);
+                this->profiler.Record(info.profileSlot, start);
+                info.lastRun = thisRun;
+            };
+
+            bool parallel = std::any_of(this->updates.begin(), this->updates.end(), [](const SystemInfo &info) {
+                return !info.access.IsMainThread();
+            });
+            if (!parallel || this->GetPool().GetWorkerCount() == 0) {
+                for (size_t i = 0; i < this->updates.size(); i++) {
+                    run(i);
+                }
+                return;
+            }
+
+            // The calling thread walks the dependency graph: ready systems go to the pool,
+            // main thread systems are run here while the workers are busy
+            std::vector<size_t> pending(this->updates.size());
+            std::vector<size_t> mainReady;
+            std::vector<size_t> finished;
+            std::mutex mutex;
+            std::condition_variable cv;
+            size_t done = 0;
+
+            auto schedule = [&](size_t index) {
+                if (this->updates[index].access.IsMainThread()) {
+                    mainReady.push_back(index);
+                    return;
+                }
+                this->pool->Submit([&, index]() {
+                    run(index);
+                    std::lock_guard lock(mutex);
+                    finished.push_back(index);
+                    cv.notify_one();
+                });
+            };
+            auto complete = [&](size_t index) {
+                done++;
+                for (auto dependent : this->updates[index].dependents) {
+                    if (--pending[dependent] == 0) {
+                        schedule(dependent);
+                    }
+                }
+            };
+
+            for (size_t i = 0; i < this->updates.size(); i++) {
+                pending[i] = this->updates[i].dependencyCount;
+                if (pending[i] == 0) {
+                    schedule(i);
+                }
+            }
+
+            std::vector<size_t> completed;
+            while (done < this->updates.size()) {
+                {
+                    std::unique_lock lock(mutex);
+                    if (mainReady.empty()) {
+                        cv.wait(lock, [&]() { return !finished.empty(); });
+                    }
+                    completed.swap(finished);
+                }
+                for (auto index : completed) {
+                    complete(index);
+                }
+                completed.clear();
+
+                if (!mainReady.empty()) {
+                    auto it = std::min_element(mainReady.begin(), mainReady.end());
+                    auto index = *it;
+                    mainReady.erase(it);
+                    run(index);
+                    complete(index);
+                }
+            }
         }
 
-        template<typename T>
-        void EventWriter<T>::Write(const T &t) {
-            e.addEventFuncs.push_back([=]() {
-                EventStaging<T>::Set(t);
+        namespace detail {
+            // Plain-old-data header of a World snapshot, followed by the sections in the order of the counts
+            struct SnapshotHeader {
+                uint64_t entityCount;
+                uint64_t freeCount;
+                uint64_t archetypeCount;
+                uint64_t componentCount;
+                uint64_t resourceCount;
+                uint64_t nextEntityIndex;
+            };
+
+            struct SnapshotRecord {
+                Signature signature;
+                uint64_t row;
+                Entity entity;
+                // Index into World::archetypes, -1 for free slots
+                int32_t archetype;
+            };
+
+            inline void Put(std::vector<std::byte> &out, const void *data, size_t size) {
+                auto at = out.size();
+                out.resize(at + size);
+                if (size > 0) {
+                    std::memcpy(out.data() + at, data, size);
+                }
+            }
+
+            template<typename T>
+            void Put(std::vector<std::byte> &out, const T &value) {
+                Put(out, &value, sizeof(T));
+            }
+
+            inline const std::byte *Take(std::span<const std::byte> in, size_t &cursor, size_t size) {
+                assertm(cursor + size <= in.size(), "Truncated snapshot");
+                auto data = in.data() + cursor;
+                cursor += size;
+                return data;
+            }
+
+            template<typename T>
+            T Take(std::span<const std::byte> in, size_t &cursor) {
+                T value;
+                std::memcpy(&value, Take(in, cursor, sizeof(T)), sizeof(T));
+                return value;
+            }
+
+            inline constexpr char WORLD_FILE_MAGIC[4] = { 'E', 'C', 'S', 'W' };
+            inline constexpr uint32_t WORLD_FILE_VERSION = 1;
+            inline constexpr size_t WORLD_FILE_ALIGN = 16;
+            inline constexpr uint32_t WORLD_FILE_TAGS = std::numeric_limits<uint32_t>::max();
+            inline constexpr uint32_t WORLD_FILE_ENTITIES = std::numeric_limits<uint32_t>::max();
+
+            // A world file starts with the header, the handle of every entity slot (null for free ones) and the
+            // free list. Data blocks follow, then the type table and the block index the header points to
+            struct WorldFileHeader {
+                char magic[4];
+                uint32_t version;
+                uint64_t slotCount;
+                uint64_t freeCount;
+                uint64_t nextEntityIndex;
+                uint64_t typeCount;
+                uint64_t typeOffset;
+                uint64_t blockCount;
+                uint64_t blockOffset;
+            };
+
+            // Every archetype has a block of entity handles followed by one block per persisted column, in
+            // the archetype's column order. Tag blocks list the entities carrying the tag
+            struct WorldFileBlock {
+                uint64_t offset;
+                uint64_t length;
+                uint64_t rows;
+                // Ordinal of the archetype in the file, WORLD_FILE_TAGS for tag blocks
+                uint32_t archetype;
+                // Index into the type table, WORLD_FILE_ENTITIES for entity handles
+                uint32_t type;
+            };
+
+            // Type table entries are the name length, the name, the component size and the flags
+            enum WorldFileTypeFlags : uint8_t {
+                WORLD_FILE_RAW = 1,
+                WORLD_FILE_TAG = 2
+            };
+
+            // Read-only view of a whole file, memory mapped where the platform allows it
+            class MappedFile final {
+            public:
+                explicit MappedFile(const std::string &path) {
+#ifdef __linux__
+                    auto fd = ::open(path.c_str(), O_RDONLY);
+                    if (fd < 0) {
+                        return;
+                    }
+                    struct stat info;
+                    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+                        auto data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                        if (data != MAP_FAILED) {
+                            ::madvise(data, info.st_size, MADV_SEQUENTIAL);
+                            this->data = (const std::byte *) data;
+                            this->size = info.st_size;
+                        }
+                    }
+                    ::close(fd);
+#else
+                    std::ifstream file(path, std::ios::binary | std::ios::ate);
+                    if (!file) {
+                        return;
+                    }
+                    this->buffer.resize(file.tellg());
+                    file.seekg(0);
+                    if (file.read((char *) this->buffer.data(), this->buffer.size())) {
+                        this->data = this->buffer.data();
+                        this->size = this->buffer.size();
+                    }
+#endif
+                }
+
+                MappedFile(const MappedFile &) = delete;
+                MappedFile &operator=(const MappedFile &) = delete;
+
+                ~MappedFile() {
+#ifdef __linux__
+                    if (this->data) {
+                        ::munmap((void *) this->data, this->size);
+                    }
+#endif
+                }
+
+                explicit operator bool() const {
+                    return this->data != nullptr;
+                }
+
+                std::span<const std::byte> Bytes() const {
+                    return { this->data, this->size };
+                }
+
+            private:
+                const std::byte *data = nullptr;
+                size_t size = 0;
+#ifndef __linux__
+                std::vector<std::byte> buffer;
+#endif
+            };
+        }
+
+        inline void World::Capture(std::vector<std::byte> &out) const {
+            out.clear();
+            size_t resourceCount = std::count_if(this->resources.begin(), this->resources.end(), [](const ResourceInfo &info) {
+                return info.resource && info.trivial;
             });
-            e.removeEventFuncs.push_back([]() {
-                EventStaging<T>::Clear();
+            detail::Put(out, detail::SnapshotHeader {
+                this->entities.size(), this->freeEntities.size(), this->archetypes.size(),
+                this->componentInfos.size(), resourceCount, this->nextEntityIndex
             });
+
+            auto at = out.size();
+            out.resize(at + this->entities.size() * sizeof(detail::SnapshotRecord));
+            for (size_t i = 0; i < this->entities.size(); i++) {
+                auto &record = this->entities[i];
+                detail::SnapshotRecord copy {
+                    record.signature, record.row, record.entity,
+                    record.archetype ? (int32_t) record.archetype->index : -1
+                };
+                std::memcpy(out.data() + at + i * sizeof(copy), &copy, sizeof(copy));
+            }
+            detail::Put(out, this->freeEntities.data(), this->freeEntities.size() * sizeof(Entity));
+
+            // Whole chunks, the unused tail of the last one included, so that layouts need no walking. Columns
+            // of other types are zeroed, the ones with a codec follow the chunks of their archetype
+            for (auto &archetype : this->archetypes) {
+                detail::Put(out, (uint64_t) archetype->count);
+                auto trivial = archetype->IsTrivial();
+                for (size_t chunk = 0; chunk < archetype->GetChunkCount(); chunk++) {
+                    auto at = out.size();
+                    detail::Put(out, archetype->chunks[chunk], archetype->chunkBytes);
+                    if (trivial) {
+                        continue;
+                    }
+                    for (auto &col : archetype->columns) {
+                        if (!col.meta.trivial) {
+                            std::memset(out.data() + at + col.offset, 0, archetype->chunkCapacity * col.meta.size);
+                        }
+                    }
+                }
+                if (trivial) {
+                    continue;
+                }
+                for (size_t c = 0; c < archetype->columns.size(); c++) {
+                    auto &col = archetype->columns[c];
+                    if (col.meta.trivial) {
+                        continue;
+                    }
+                    if (!this->IsPersisted(col.id) || !this->persisted[col.id].write) {
+                        assertm(archetype->count == 0 || this->transient.test(col.id), "Component captured without a codec, persist it or mark it Transient");
+                        continue;
+                    }
+                    // Block size first, patched once the rows are encoded
+                    auto at = out.size();
+                    detail::Put(out, (uint64_t) 0);
+                    for (size_t row = 0; row < archetype->count; row++) {
+                        this->persisted[col.id].write(archetype->Get(c, row), out);
+                    }
+                    uint64_t size = out.size() - at - sizeof(uint64_t);
+                    std::memcpy(out.data() + at, &size, sizeof(size));
+                }
+            }
+            for (auto &info : this->componentInfos) {
+                auto size = info.sparseSet.Size();
+                detail::Put(out, (uint64_t) size);
+                detail::Put(out, info.sparseSet.Data(), size * sizeof(Entity));
+            }
+            for (uint32_t id = 0; id < this->resources.size(); id++) {
+                auto &info = this->resources[id];
+                if (info.resource && info.trivial) {
+                    detail::Put(out, id);
+                    detail::Put(out, (uint64_t) info.size);
+                    detail::Put(out, info.resource, info.size);
+                }
+            }
+        }
+
+        inline void World::Restore(std::span<const std::byte> snapshot) {
+            size_t cursor = 0;
+            auto header = detail::Take<detail::SnapshotHeader>(snapshot, cursor);
+            assertm(header.archetypeCount <= this->archetypes.size(), "Snapshot taken before the last shutdown");
+            assertm(header.componentCount <= this->componentInfos.size(), "Snapshot taken before the last shutdown");
+
+            this->entities.resize(header.entityCount);
+            for (auto &record : this->entities) {
+                auto copy = detail::Take<detail::SnapshotRecord>(snapshot, cursor);
+                record = EntityRecord {
+                    copy.signature, copy.archetype >= 0 ? this->archetypes[copy.archetype].get() : nullptr,
+                    (size_t) copy.row, copy.entity
+                };
+            }
+            auto free = detail::Take(snapshot, cursor, header.freeCount * sizeof(Entity));
+            // An empty free list has no data to copy into
+            this->freeEntities.resize(header.freeCount);
+            if (header.freeCount != 0) {
+                std::memcpy(this->freeEntities.data(), free, header.freeCount * sizeof(Entity));
+            }
+            this->nextEntityIndex = (uint32_t) header.nextEntityIndex;
+
+            for (size_t i = 0; i < this->archetypes.size(); i++) {
+                auto &archetype = *this->archetypes[i];
+                archetype.Clear();
+                if (i >= header.archetypeCount) {
+                    continue;
+                }
+                auto count = detail::Take<uint64_t>(snapshot, cursor);
+                archetype.Reserve(count);
+                archetype.count = count;
+                for (size_t chunk = 0; chunk < archetype.GetChunkCount(); chunk++) {
+                    std::memcpy(archetype.chunks[chunk], detail::Take(snapshot, cursor, archetype.chunkBytes), archetype.chunkBytes);
+                }
+                if (archetype.IsTrivial()) {
+                    continue;
+                }
+                // The zeroed rows of the other columns are constructed in place
+                for (size_t c = 0; c < archetype.columns.size(); c++) {
+                    auto &col = archetype.columns[c];
+                    if (col.meta.trivial) {
+                        continue;
+                    }
+                    if (this->IsPersisted(col.id) && this->persisted[col.id].read) {
+                        auto size = detail::Take<uint64_t>(snapshot, cursor);
+                        std::span<const std::byte> block(detail::Take(snapshot, cursor, size), size);
+                        size_t offset = 0;
+                        for (size_t row = 0; row < count; row++) {
+                            this->persisted[col.id].read(archetype.Get(c, row), block, offset);
+                        }
+                    } else {
+                        for (size_t row = 0; row < count; row++) {
+                            col.meta.construct(archetype.Get(c, row));
+                        }
+                    }
+                }
+            }
+            for (size_t id = 0; id < this->componentInfos.size(); id++) {
+                auto &set = this->componentInfos[id].sparseSet;
+                if (id >= header.componentCount) {
+                    set.Assign(nullptr, 0);
+                    continue;
+                }
+                auto size = detail::Take<uint64_t>(snapshot, cursor);
+                set.Assign(detail::Take(snapshot, cursor, size * sizeof(Entity)), size);
+            }
+            for (size_t i = 0; i < header.resourceCount; i++) {
+                auto id = detail::Take<uint32_t>(snapshot, cursor);
+                auto size = detail::Take<uint64_t>(snapshot, cursor);
+                auto data = detail::Take(snapshot, cursor, size);
+                if (id < this->resources.size() && this->resources[id].resource) {
+                    assert(this->resources[id].size == size);
+                    std::memcpy(this->resources[id].resource, data, size);
+                }
+            }
+        }
+
+        // Keeps the last `capacity` snapshots of a world for rollback. The newest one is stored whole, every
+        // older one as the run-length encoded XOR against its successor, which is mostly zeros between frames
+        class SnapshotRing final {
+        public:
+            explicit SnapshotRing(size_t capacity) : deltas(capacity > 0 ? capacity - 1 : 0) {
+                assertm(capacity > 0, "Snapshot ring needs room for one snapshot");
+            }
+
+            void Push(const World &world) {
+                world.Capture(this->scratch);
+                if (!this->latest.empty() && !this->deltas.empty()) {
+                    Encode(this->latest, this->scratch, this->deltas[this->head]);
+                    this->head = (this->head + 1) % this->deltas.size();
+                    this->deltaCount = std::min(this->deltaCount + 1, this->deltas.size());
+                }
+                std::swap(this->latest, this->scratch);
+            }
+
+            size_t Size() const {
+                return this->latest.empty() ? 0 : this->deltaCount + 1;
+            }
+
+            // Age 0 is the newest snapshot, age 1 the one pushed before it and so on
+            void Restore(World &world, size_t age) {
+                assertm(age < this->Size(), "Snapshot is no longer kept");
+                this->scratch = this->latest;
+                for (size_t i = 1; i <= age; i++) {
+                    Apply(this->scratch, this->deltas[(this->head + this->deltas.size() - i) % this->deltas.size()]);
+                }
+                world.Restore(this->scratch);
+            }
+
+            // Forgets the snapshots older than `age`, so that a restored frame becomes the newest
+            void Rewind(size_t age) {
+                assertm(age < this->Size(), "Snapshot is no longer kept");
+                for (size_t i = 0; i < age; i++) {
+                    this->head = (this->head + this->deltas.size() - 1) % this->deltas.size();
+                    Apply(this->latest, this->deltas[this->head]);
+                    this->deltaCount--;
+                }
+            }
+
+        private:
+            std::vector<std::byte> latest;
+            std::vector<std::byte> scratch;
+            // Ring of reverse deltas, the one at head - 1 turns the newest snapshot into the previous one
+            std::vector<std::vector<std::byte>> deltas;
+            size_t head = 0;
+            size_t deltaCount = 0;
+
+            // The delta is the size of `older` followed by (zero run, literal length, literal bytes) runs
+            // of older ^ newer, the shorter of the two being padded with zeros
+            static void Encode(const std::vector<std::byte> &older, const std::vector<std::byte> &newer, std::vector<std::byte> &delta) {
+                auto length = std::max(older.size(), newer.size());
+                auto at = [&](size_t i) {
+                    return (i < older.size() ? older[i] : std::byte {}) ^ (i < newer.size() ? newer[i] : std::byte {});
+                };
+                auto common = std::min(older.size(), newer.size());
+                delta.clear();
+                detail::Put(delta, (uint64_t) older.size());
+                size_t i = 0;
+                while (i < length) {
+                    auto start = i;
+                    // Equal words are skipped 8 bytes at a time
+                    while (i + sizeof(uint64_t) <= common && std::memcmp(older.data() + i, newer.data() + i, sizeof(uint64_t)) == 0) {
+                        i += sizeof(uint64_t);
+                    }
+                    while (i < length && at(i) == std::byte {}) {
+                        i++;
+                    }
+                    auto zeros = i - start;
+                    auto literal = i;
+                    // A literal run ends at the first 8 equal bytes, shorter gaps are cheaper to inline
+                    while (i < length) {
+                        if (i + sizeof(uint64_t) <= common && std::memcmp(older.data() + i, newer.data() + i, sizeof(uint64_t)) == 0) {
+                            break;
+                        }
+                        i++;
+                    }
+                    if (zeros == 0 && i == literal) {
+                        break;
+                    }
+                    detail::Put(delta, (uint64_t) zeros);
+                    detail::Put(delta, (uint64_t) (i - literal));
+                    auto base = delta.size();
+                    delta.resize(base + i - literal);
+                    for (size_t k = literal; k < i; k++) {
+                        delta[base + k - literal] = at(k);
+                    }
+                }
+            }
+
+            // Turns the snapshot the delta was encoded against into the older one
+            static void Apply(std::vector<std::byte> &snapshot, const std::vector<std::byte> &delta) {
+                size_t cursor = 0;
+                auto size = detail::Take<uint64_t>(delta, cursor);
+                if (snapshot.size() < size) {
+                    snapshot.resize(size);
+                }
+                size_t i = 0;
+                while (cursor < delta.size()) {
+                    i += detail::Take<uint64_t>(delta, cursor);
+                    auto literal = detail::Take<uint64_t>(delta, cursor);
+                    auto data = detail::Take(delta, cursor, literal);
+                    if (snapshot.size() < i + literal) {
+                        snapshot.resize(i + literal);
+                    }
+                    for (size_t k = 0; k < literal; k++) {
+                        snapshot[i + k] ^= data[k];
+                    }
+                    i += literal;
+                }
+                snapshot.resize(size);
+            }
+        };
+
+        inline bool World::Save(const std::string &path) const {
+            using namespace detail;
+            std::vector<std::byte> out(sizeof(WorldFileHeader));
+            WorldFileHeader header {};
+            std::copy_n(WORLD_FILE_MAGIC, 4, header.magic);
+            header.version = WORLD_FILE_VERSION;
+            header.slotCount = this->entities.size();
+            header.freeCount = this->freeEntities.size();
+            header.nextEntityIndex = this->nextEntityIndex;
+            for (auto &record : this->entities) {
+                Put(out, record.entity);
+            }
+            Put(out, this->freeEntities.data(), this->freeEntities.size() * sizeof(Entity));
+
+            // File type indices are handed out in order of first use
+            std::vector<ComponentID> types;
+            std::vector<uint32_t> fileTypes(this->componentInfos.size(), WORLD_FILE_ENTITIES);
+            auto typeOf = [&](ComponentID id) {
+                if (fileTypes[id] == WORLD_FILE_ENTITIES) {
+                    fileTypes[id] = types.size();
+                    types.push_back(id);
+                }
+                return fileTypes[id];
+            };
+            std::vector<WorldFileBlock> blocks;
+            auto begin = [&]() {
+                out.resize((out.size() + WORLD_FILE_ALIGN - 1) / WORLD_FILE_ALIGN * WORLD_FILE_ALIGN);
+                return out.size();
+            };
+            auto end = [&](uint64_t offset, uint64_t rows, uint32_t archetype, uint32_t type) {
+                blocks.push_back(WorldFileBlock { offset, out.size() - offset, rows, archetype, type });
+            };
+
+            uint32_t ordinal = 0;
+            for (auto &archetype : this->archetypes) {
+                auto rows = archetype->count;
+                if (rows == 0) {
+                    continue;
+                }
+                auto offset = begin();
+                for (size_t chunk = 0; chunk < archetype->GetChunkCount(); chunk++) {
+                    Put(out, archetype->chunks[chunk], archetype->GetChunkSize(chunk) * sizeof(Entity));
+                }
+                end(offset, rows, ordinal, WORLD_FILE_ENTITIES);
+                for (size_t c = 0; c < archetype->columns.size(); c++) {
+                    auto &col = archetype->columns[c];
+                    if (!this->IsPersisted(col.id)) {
+                        continue;
+                    }
+                    offset = begin();
+                    auto &write = this->persisted[col.id].write;
+                    if (!write) {
+                        for (size_t chunk = 0; chunk < archetype->GetChunkCount(); chunk++) {
+                            Put(out, archetype->chunks[chunk] + col.offset, archetype->GetChunkSize(chunk) * col.meta.size);
+                        }
+                    } else {
+                        for (size_t row = 0; row < rows; row++) {
+                            write(archetype->chunks[row / archetype->chunkCapacity] + col.offset + (row % archetype->chunkCapacity) * col.meta.size, out);
+                        }
+                    }
+                    end(offset, rows, ordinal, typeOf(col.id));
+                }
+                ordinal++;
+            }
+            for (ComponentID id = 0; id < this->componentInfos.size(); id++) {
+                auto &info = this->componentInfos[id];
+                if (info.registered && info.meta.tag && this->IsPersisted(id) && info.sparseSet.Size() > 0) {
+                    auto offset = begin();
+                    Put(out, info.sparseSet.Data(), info.sparseSet.Size() * sizeof(Entity));
+                    end(offset, info.sparseSet.Size(), WORLD_FILE_TAGS, typeOf(id));
+                }
+            }
+
+            header.typeCount = types.size();
+            header.typeOffset = out.size();
+            for (auto id : types) {
+                auto &name = this->persisted[id].name;
+                auto &meta = this->componentInfos[id].meta;
+                Put(out, (uint32_t) name.size());
+                Put(out, name.data(), name.size());
+                Put(out, (uint32_t) meta.size);
+                Put(out, (uint8_t) ((this->persisted[id].write ? 0 : WORLD_FILE_RAW) | (meta.tag ? WORLD_FILE_TAG : 0)));
+            }
+            header.blockCount = blocks.size();
+            header.blockOffset = begin();
+            Put(out, blocks.data(), blocks.size() * sizeof(WorldFileBlock));
+            std::memcpy(out.data(), &header, sizeof(header));
+
+            std::ofstream file(path, std::ios::binary);
+            file.write((const char *) out.data(), out.size());
+            return file.good();
+        }
+
+        inline bool World::Load(const std::string &path) {
+            using namespace detail;
+            assertm(this->entities.empty(), "Worlds are loaded empty");
+            MappedFile file(path);
+            if (!file || file.Bytes().size() < sizeof(WorldFileHeader)) {
+                return false;
+            }
+            auto bytes = file.Bytes();
+            size_t cursor = 0;
+            auto header = Take<WorldFileHeader>(bytes, cursor);
+            if (!std::equal(header.magic, header.magic + 4, WORLD_FILE_MAGIC) || header.version != WORLD_FILE_VERSION) {
+                return false;
+            }
+            auto fits = [&](uint64_t offset, uint64_t length) {
+                return offset <= bytes.size() && length <= bytes.size() - offset;
+            };
+            // Counts are bounded first, so that the products below cannot wrap around
+            auto limit = bytes.size();
+            if (header.slotCount > limit || header.freeCount > limit || header.blockCount > limit
+                || !fits(sizeof(WorldFileHeader), (header.slotCount + header.freeCount) * sizeof(Entity))
+                || !fits(header.blockOffset, header.blockCount * sizeof(WorldFileBlock))) {
+                return false;
+            }
+            auto slot = [&](uint64_t index) {
+                Entity entity;
+                std::memcpy(&entity, bytes.data() + sizeof(WorldFileHeader) + index * sizeof(Entity), sizeof(Entity));
+                return entity;
+            };
+            if (header.nextEntityIndex < header.slotCount || header.nextEntityIndex >= EntityTraits::INDEX_MASK) {
+                return false;
+            }
+
+            // Everything is checked before the world is touched, so a rejected file leaves it empty
+            std::vector<ComponentID> types;
+            cursor = header.typeOffset;
+            for (uint64_t i = 0; i < header.typeCount; i++) {
+                if (!fits(cursor, sizeof(uint32_t))) {
+                    return false;
+                }
+                auto length = Take<uint32_t>(bytes, cursor);
+                if (!fits(cursor, length + sizeof(uint32_t) + sizeof(uint8_t))) {
+                    return false;
+                }
+                std::string name((const char *) Take(bytes, cursor, length), length);
+                auto size = Take<uint32_t>(bytes, cursor);
+                auto flags = Take<uint8_t>(bytes, cursor);
+                auto it = std::find_if(this->persisted.begin(), this->persisted.end(), [&](const PersistInfo &info) {
+                    return info.name == name;
+                });
+                if (name.empty() || it == this->persisted.end()) {
+                    return false;
+                }
+                ComponentID id = it - this->persisted.begin();
+                auto &meta = this->componentInfos[id].meta;
+                if (meta.size != size || meta.tag != bool(flags & WORLD_FILE_TAG) || !it->write != bool(flags & WORLD_FILE_RAW)) {
+                    return false;
+                }
+                types.push_back(id);
+            }
+            std::vector<WorldFileBlock> blocks(header.blockCount);
+            std::memcpy(blocks.data(), bytes.data() + header.blockOffset, blocks.size() * sizeof(WorldFileBlock));
+            for (auto &block : blocks) {
+                if (!fits(block.offset, block.length) || (block.type != WORLD_FILE_ENTITIES && block.type >= types.size())) {
+                    return false;
+                }
+                auto raw = block.type == WORLD_FILE_ENTITIES || block.archetype == WORLD_FILE_TAGS
+                    || !this->persisted[types[block.type]].write;
+                auto size = block.type == WORLD_FILE_ENTITIES || block.archetype == WORLD_FILE_TAGS
+                    ? sizeof(Entity) : this->componentInfos[types[block.type]].meta.size;
+                if (raw && (block.length % size != 0 || block.rows != block.length / size)) {
+                    return false;
+                }
+            }
+
+            // Archetypes are an entity block followed by their column blocks, each with as many rows and no
+            // type twice. Every handle has to be the one saved in its slot and sit in a single archetype,
+            // tag blocks may only list placed entities, each once
+            std::vector<uint8_t> marks(header.slotCount);
+            auto mark = [&](const WorldFileBlock &block, uint8_t from, uint8_t to) {
+                for (uint64_t r = 0; r < block.rows; r++) {
+                    Entity entity;
+                    std::memcpy(&entity, bytes.data() + block.offset + r * sizeof(Entity), sizeof(Entity));
+                    auto index = EntityTraits::ToIndex(entity);
+                    if (index >= header.slotCount || slot(index) != entity || marks[index] != from) {
+                        return false;
+                    }
+                    marks[index] = to;
+                }
+                return true;
+            };
+            Signature tags;
+            for (size_t i = 0; i < blocks.size();) {
+                auto &first = blocks[i];
+                if (first.archetype == WORLD_FILE_TAGS) {
+                    if (first.type == WORLD_FILE_ENTITIES) {
+                        return false;
+                    }
+                    auto id = types[first.type];
+                    if (!this->componentInfos[id].meta.tag || tags.test(id) || !mark(first, 1, 2)) {
+                        return false;
+                    }
+                    tags.set(id);
+                    mark(first, 2, 1);
+                    i++;
+                    continue;
+                }
+                if (first.type != WORLD_FILE_ENTITIES || !mark(first, 0, 1)) {
+                    return false;
+                }
+                auto end = i + 1;
+                Signature signature;
+                while (end < blocks.size() && blocks[end].archetype == first.archetype && blocks[end].type != WORLD_FILE_ENTITIES) {
+                    auto id = types[blocks[end].type];
+                    if (blocks[end].rows != first.rows || signature.test(id) || this->componentInfos[id].meta.tag) {
+                        return false;
+                    }
+                    signature.set(id);
+                    end++;
+                }
+                i = end;
+            }
+            // Free handles may only name slots no archetype holds
+            for (uint64_t i = 0; i < header.freeCount; i++) {
+                auto free = slot(header.slotCount + i);
+                auto index = EntityTraits::ToIndex(free);
+                if (index >= header.slotCount || marks[index] != 0) {
+                    return false;
+                }
+                marks[index] = 1;
+            }
+
+            cursor = sizeof(WorldFileHeader);
+            this->entities.resize(header.slotCount);
+            for (auto &record : this->entities) {
+                record.entity = Take<Entity>(bytes, cursor);
+            }
+            auto free = Take(bytes, cursor, header.freeCount * sizeof(Entity));
+            // An empty free list has no data to copy into
+            this->freeEntities.resize(header.freeCount);
+            if (header.freeCount != 0) {
+                std::memcpy(this->freeEntities.data(), free, header.freeCount * sizeof(Entity));
+            }
+            this->nextEntityIndex = (uint32_t) header.nextEntityIndex;
+
+            auto tick = this->NextTick();
+            std::vector<Entity> handles;
+            for (size_t i = 0; i < blocks.size();) {
+                auto &first = blocks[i];
+                if (first.archetype == WORLD_FILE_TAGS) {
+                    i++;
+                    continue;
+                }
+                auto end = i + 1;
+                Signature signature;
+                while (end < blocks.size() && blocks[end].archetype == first.archetype && blocks[end].type != WORLD_FILE_ENTITIES) {
+                    signature.set(types[blocks[end].type]);
+                    end++;
+                }
+                auto rows = first.rows;
+                handles.resize(rows);
+                std::memcpy(handles.data(), bytes.data() + first.offset, rows * sizeof(Entity));
+                auto archetype = this->GetArchetype(signature);
+                auto row = archetype->Allocate(handles.data(), rows);
+
+                for (auto k = i + 1; k < end; k++) {
+                    auto &block = blocks[k];
+                    auto id = types[block.type];
+                    auto column = archetype->FindColumn(id);
+                    auto &col = archetype->columns[column];
+                    auto data = bytes.subspan(block.offset, block.length);
+                    auto &read = this->persisted[id].read;
+                    if (!read) {
+                        // One bulk copy per chunk straight out of the mapping
+                        for (size_t done = 0; done < rows;) {
+                            auto at = row + done;
+                            auto run = std::min<size_t>(rows - done, archetype->chunkCapacity - at % archetype->chunkCapacity);
+                            std::memcpy(archetype->Get(column, at), data.data() + done * col.meta.size, run * col.meta.size);
+                            done += run;
+                        }
+                    } else {
+                        size_t offset = 0;
+                        for (size_t r = 0; r < rows; r++) {
+                            read(archetype->Get(column, row + r), data, offset);
+                        }
+                    }
+                    archetype->Stamp(column, row, rows, tick);
+                    auto &set = this->componentInfos[id].sparseSet;
+                    set.Reserve(set.Size() + rows);
+                    for (auto entity : handles) {
+                        set.Add(entity);
+                    }
+                }
+                for (size_t r = 0; r < rows; r++) {
+                    this->Record(handles[r]) = EntityRecord { signature, archetype, row + r, handles[r] };
+                }
+                i = end;
+            }
+            for (auto &block : blocks) {
+                if (block.archetype != WORLD_FILE_TAGS) {
+                    continue;
+                }
+                auto id = types[block.type];
+                handles.resize(block.rows);
+                std::memcpy(handles.data(), bytes.data() + block.offset, block.rows * sizeof(Entity));
+                for (auto entity : handles) {
+                    this->Record(entity).signature.set(id);
+                    this->componentInfos[id].AddEntity(entity);
+                }
+            }
+            return true;
+        }
+
+        template<typename T>
+        World &World::SetResource(T &&resource) {
+            this->PutResource(std::forward<T>(resource));
+            return *this;
+        }
+
+        template<typename T>
+        World &World::InitResource() {
+            if (!Resources(*this).Has<T>()) {
+                this->PutResource(T());
+            }
+            return *this;
         }
     }
 }
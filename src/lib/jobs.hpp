@@ -0,0 +1,171 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+
+namespace engine {
+
+    // Work-stealing pool: every worker owns a deque, pops its own jobs LIFO and steals FIFO from the others
+    class ThreadPool final {
+    public:
+        using Job = std::function<void()>;
+
+        explicit ThreadPool(size_t workerCount = DefaultWorkerCount()) {
+            for (size_t i = 0; i < workerCount; i++) {
+                this->queues.push_back(std::make_unique<Queue>());
+            }
+            for (size_t i = 0; i < workerCount; i++) {
+                this->workers.emplace_back([this, i]() {
+                    this->WorkerLoop((int) i);
+                });
+            }
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard lock(this->sleepMutex);
+                this->stopping = true;
+            }
+            this->cv.notify_all();
+            for (auto &worker : this->workers) {
+                worker.join();
+            }
+        }
+
+        // The thread that owns the pool is expected to work as well, so leave one core to it
+        static size_t DefaultWorkerCount() {
+            auto cores = std::thread::hardware_concurrency();
+            return cores > 1 ? cores - 1 : 0;
+        }
+
+        size_t GetWorkerCount() const {
+            return this->workers.size();
+        }
+
+        // Index of the pool worker running the calling thread, -1 for threads outside the pool
+        int CurrentWorkerIndex() const {
+            return currentPool == this ? currentWorker : -1;
+        }
+
+        void Submit(Job job) {
+            auto self = this->CurrentWorkerIndex();
+            auto &queue = *this->queues[self >= 0 ? self : this->nextQueue++ % this->queues.size()];
+            {
+                std::lock_guard lock(queue.mutex);
+                queue.jobs.push_back(std::move(job));
+            }
+            {
+                std::lock_guard lock(this->sleepMutex);
+                this->pendingJobs++;
+            }
+            this->cv.notify_one();
+        }
+
+        // Runs func(i) for every i in [0, count) and returns once all of them are done. The calling
+        // thread runs (and steals) jobs meanwhile, so it may be used from inside a pool job as well
+        template<typename Func>
+        void ParallelFor(size_t count, Func &&func) {
+            if (count == 0) {
+                return;
+            }
+            if (this->workers.empty() || count == 1) {
+                for (size_t i = 0; i < count; i++) {
+                    func(i);
+                }
+                return;
+            }
+
+            std::atomic<size_t> remaining = count;
+            for (size_t i = 1; i < count; i++) {
+                this->Submit([&, i]() {
+                    func(i);
+                    remaining--;
+                });
+            }
+            func(0);
+            remaining--;
+
+            auto self = this->CurrentWorkerIndex();
+            while (remaining > 0) {
+                if (!this->TryRunOne(self)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Job> jobs;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<size_t> nextQueue = 0;
+        std::mutex sleepMutex;
+        std::condition_variable cv;
+        size_t pendingJobs = 0;
+        bool stopping = false;
+
+        inline static thread_local ThreadPool *currentPool = nullptr;
+        inline static thread_local int currentWorker = -1;
+
+        bool TryRunOne(int self) {
+            Job job;
+            if (self >= 0) {
+                auto &own = *this->queues[self];
+                std::lock_guard lock(own.mutex);
+                if (!own.jobs.empty()) {
+                    job = std::move(own.jobs.back());
+                    own.jobs.pop_back();
+                }
+            }
+            for (size_t i = 0; !job && i < this->queues.size(); i++) {
+                auto victim = (std::max(self, 0) + i) % this->queues.size();
+                if ((int) victim == self) {
+                    continue;
+                }
+                auto &queue = *this->queues[victim];
+                std::lock_guard lock(queue.mutex);
+                if (!queue.jobs.empty()) {
+                    job = std::move(queue.jobs.front());
+                    queue.jobs.pop_front();
+                }
+            }
+            if (!job) {
+                return false;
+            }
+            {
+                std::lock_guard lock(this->sleepMutex);
+                this->pendingJobs--;
+            }
+            job();
+            return true;
+        }
+
+        void WorkerLoop(int index) {
+            currentPool = this;
+            currentWorker = index;
+            while (true) {
+                if (this->TryRunOne(index)) {
+                    continue;
+                }
+                std::unique_lock lock(this->sleepMutex);
+                this->cv.wait(lock, [this]() { return this->stopping || this->pendingJobs > 0; });
+                if (this->stopping && this->pendingJobs == 0) {
+                    return;
+                }
+            }
+        }
+    };
+}
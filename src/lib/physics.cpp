@@ -0,0 +1,476 @@
+#include "physics.h"
+#include <numeric>
+
+
+using engine::Vec2;
+using engine::components::Movement;
+using engine::physics::RigidBody;
+using engine::physics::Shape;
+
+// Seconds covered by the current update, fixed when the world runs a fixed timestep
+static float StepDelta(engine::ecs::Resources &r) {
+    return r.Has<engine::ecs::Time>() ? r.Get<engine::ecs::Time>().delta : engine::Renderer::GetDeltatime();
+}
+
+static Vec2 HalfExtents(const RigidBody &body) {
+    return body.shape == Shape::Circle ? Vec2(body.size.x / 2, body.size.x / 2) : Vec2(body.size.x / 2, body.size.y / 2);
+}
+
+static float Dot(const Vec2 &a, const Vec2 &b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+// Box against circle, `normal` points from the box to the circle
+static bool BoxCircle(const Vec2 &box, const Vec2 &half, const Vec2 &circle, float radius, Vec2 &normal, float &penetration) {
+    auto dx = circle.x - box.x, dy = circle.y - box.y;
+    auto cx = std::clamp(dx, -half.x, half.x), cy = std::clamp(dy, -half.y, half.y);
+    if (cx == dx && cy == dy) {
+        // The center is inside, push out through the nearest face
+        auto ox = half.x - std::abs(dx), oy = half.y - std::abs(dy);
+        if (ox < oy) {
+            normal = Vec2(dx < 0 ? -1 : 1, 0);
+            penetration = ox + radius;
+        } else {
+            normal = Vec2(0, dy < 0 ? -1 : 1);
+            penetration = oy + radius;
+        }
+        return true;
+    }
+    auto nx = dx - cx, ny = dy - cy;
+    auto distance2 = nx * nx + ny * ny;
+    if (distance2 >= radius * radius) {
+        return false;
+    }
+    auto distance = std::sqrt(distance2);
+    normal = Vec2(nx / distance, ny / distance);
+    penetration = radius - distance;
+    return true;
+}
+
+// `normal` points from a to b
+template<typename Body>
+static bool Collide(const Body &a, const Body &b, Vec2 &normal, float &penetration) {
+    auto dx = b.center.x - a.center.x, dy = b.center.y - a.center.y;
+    if (a.shape == Shape::Box && b.shape == Shape::Box) {
+        auto ox = a.half.x + b.half.x - std::abs(dx);
+        auto oy = a.half.y + b.half.y - std::abs(dy);
+        if (ox <= 0 || oy <= 0) {
+            return false;
+        }
+        if (ox < oy) {
+            normal = Vec2(dx < 0 ? -1 : 1, 0);
+            penetration = ox;
+        } else {
+            normal = Vec2(0, dy < 0 ? -1 : 1);
+            penetration = oy;
+        }
+        return true;
+    }
+    if (a.shape == Shape::Circle && b.shape == Shape::Circle) {
+        auto radius = a.half.x + b.half.x;
+        auto distance2 = dx * dx + dy * dy;
+        if (distance2 >= radius * radius) {
+            return false;
+        }
+        auto distance = std::sqrt(distance2);
+        normal = distance > 0 ? Vec2(dx / distance, dy / distance) : Vec2(0, 1);
+        penetration = radius - distance;
+        return true;
+    }
+    if (a.shape == Shape::Box) {
+        return BoxCircle(a.center, a.half, b.center, b.half.x, normal, penetration);
+    }
+    if (!BoxCircle(b.center, b.half, a.center, a.half.x, normal, penetration)) {
+        return false;
+    }
+    normal = -normal;
+    return true;
+}
+
+void engine::physics::PhysicsWorld::Track(ecs::Entity entity) {
+    this->pending.push_back(entity);
+}
+
+void engine::physics::PhysicsWorld::Untrack(ecs::Entity entity) {
+    std::erase(this->pending, entity);
+    auto index = ecs::EntityTraits::ToIndex(entity);
+    if (index >= this->slots.size() || this->slots[index].entity != entity) {
+        return;
+    }
+    auto &slot = this->slots[index];
+    if (slot.state == State::Asleep) {
+        this->Wake(entity);
+    }
+    if (slot.state == State::Awake) {
+        this->RemoveAwake(entity);
+    } else if (slot.state == State::Static) {
+        // Whatever slept on it has to fall, the margin catches bodies resting right on top
+        auto margin = Vec2(this->settings.slop, this->settings.slop);
+        this->hits.clear();
+        this->resting.QueryAABB(this->resting.GetPos(slot.proxy) - margin, this->resting.GetSize(slot.proxy) + margin + margin, [&](uint32_t data) {
+            this->hits.push_back(data);
+            return true;
+        });
+        this->resting.Remove(slot.proxy);
+        for (auto hit : this->hits) {
+            this->Wake(hit);
+        }
+    }
+    slot = Slot {};
+}
+
+void engine::physics::PhysicsWorld::Refresh(ecs::Entity entity, const RigidBody &body) {
+    auto index = ecs::EntityTraits::ToIndex(entity);
+    if (index >= this->slots.size() || this->slots[index].entity != entity || this->slots[index].state == State::None) {
+        return;
+    }
+    if ((this->slots[index].state == State::Static) != (body.mass <= 0)) {
+        this->Untrack(entity);
+        this->Track(entity);
+    } else {
+        this->Wake(entity);
+    }
+}
+
+void engine::physics::PhysicsWorld::Wake(ecs::Entity entity) {
+    auto index = ecs::EntityTraits::ToIndex(entity);
+    if (index >= this->slots.size() || this->slots[index].entity != entity || this->slots[index].state != State::Asleep) {
+        return;
+    }
+    auto island = this->slots[index].index;
+    for (auto member : this->islands[island]) {
+        auto &slot = this->SlotOf(member);
+        this->resting.Remove(slot.proxy);
+        slot.proxy = AABBTree::null;
+        slot.sleepTime = 0;
+        this->AddAwake(member);
+    }
+    this->islands[island].clear();
+    this->freeIslands.push_back(island);
+}
+
+bool engine::physics::PhysicsWorld::IsAwake(ecs::Entity entity) const {
+    auto index = ecs::EntityTraits::ToIndex(entity);
+    return index < this->slots.size() && this->slots[index].entity == entity && this->slots[index].state == State::Awake;
+}
+
+engine::physics::PhysicsWorld::Slot &engine::physics::PhysicsWorld::SlotOf(ecs::Entity entity) {
+    auto index = ecs::EntityTraits::ToIndex(entity);
+    if (index >= this->slots.size()) {
+        this->slots.resize(index + 1);
+    }
+    return this->slots[index];
+}
+
+void engine::physics::PhysicsWorld::AddAwake(ecs::Entity entity) {
+    auto &slot = this->SlotOf(entity);
+    slot.state = State::Awake;
+    slot.index = this->awake.size();
+    this->awake.push_back(entity);
+}
+
+void engine::physics::PhysicsWorld::RemoveAwake(ecs::Entity entity) {
+    auto &slot = this->SlotOf(entity);
+    auto last = this->awake.back();
+    this->awake[slot.index] = last;
+    this->SlotOf(last).index = slot.index;
+    this->awake.pop_back();
+    slot.state = State::None;
+}
+
+// Copies the body into `bodies` the first time the step needs it
+uint32_t engine::physics::PhysicsWorld::BodyOf(ecs::Querier &q, ecs::Entity entity) {
+    auto &slot = this->SlotOf(entity);
+    if (slot.step == this->stepCount) {
+        return slot.body;
+    }
+    auto &body = q.Get<const RigidBody>(entity);
+    auto &movement = q.Get<const Movement>(entity);
+    auto half = HalfExtents(body);
+    auto dynamic = slot.state == State::Awake;
+    this->bodies.push_back(Body {
+        entity, Vec2(movement.pos.x + half.x, movement.pos.y + half.y), half,
+        dynamic ? body.velocity : Vec2(), dynamic ? 1 / body.mass : 0, body.restitution, body.friction, body.shape
+    });
+    slot.step = this->stepCount;
+    slot.body = this->bodies.size() - 1;
+    return slot.body;
+}
+
+void engine::physics::PhysicsWorld::Sleep(ecs::Querier &q, std::span<const ecs::Entity> members) {
+    uint32_t island;
+    if (!this->freeIslands.empty()) {
+        island = this->freeIslands.back();
+        this->freeIslands.pop_back();
+    } else {
+        island = this->islands.size();
+        this->islands.emplace_back();
+    }
+    for (auto entity : members) {
+        this->RemoveAwake(entity);
+        auto &body = q.Get<RigidBody>(entity);
+        body.velocity = Vec2();
+        auto &slot = this->SlotOf(entity);
+        slot.state = State::Asleep;
+        slot.index = island;
+        slot.proxy = this->resting.Insert(q.Get<const Movement>(entity).pos, Vec2(body.size.x, body.shape == Shape::Circle ? body.size.x : body.size.y), entity);
+        this->islands[island].push_back(entity);
+    }
+}
+
+uint32_t engine::physics::PhysicsWorld::Find(uint32_t body) {
+    while (this->parents[body] != body) {
+        this->parents[body] = this->parents[this->parents[body]];
+        body = this->parents[body];
+    }
+    return body;
+}
+
+void engine::physics::PhysicsWorld::Step(ecs::Querier &q, float dt) {
+    if (dt <= 0) {
+        return;
+    }
+    this->stepCount++;
+    if (this->grid.GetCellSize() != this->settings.cellSize) {
+        this->grid = SpatialHash(this->settings.cellSize);
+    }
+
+    // Bodies without a Movement yet stay queued
+    size_t waiting = 0;
+    for (size_t i = 0; i < this->pending.size(); i++) {
+        auto entity = this->pending[i];
+        if (!q.Has<RigidBody>(entity)) {
+            continue;
+        }
+        if (!q.Has<Movement>(entity)) {
+            this->pending[waiting++] = entity;
+            continue;
+        }
+        auto &slot = this->SlotOf(entity);
+        if (slot.entity == entity && slot.state != State::None) {
+            continue;
+        }
+        slot = Slot { entity };
+        auto &body = q.Get<const RigidBody>(entity);
+        if (body.mass > 0) {
+            this->AddAwake(entity);
+        } else {
+            slot.state = State::Static;
+            slot.proxy = this->resting.Insert(q.Get<const Movement>(entity).pos, Vec2(body.size.x, body.shape == Shape::Circle ? body.size.x : body.size.y), entity);
+        }
+    }
+    this->pending.resize(waiting);
+
+    // Awake bodies get their forces applied and look for resting bodies in reach. Islands woken
+    // up on the way are appended to `awake` and handled by the same loop
+    auto &gravity = this->settings.gravity;
+    this->bodies.clear();
+    this->pairs.clear();
+    for (size_t i = 0; i < this->awake.size(); i++) {
+        auto entity = this->awake[i];
+        auto &component = q.Get<RigidBody>(entity);
+        auto invMass = 1 / component.mass;
+        component.velocity.x += (gravity.x * component.gravityScale + component.force.x * invMass) * dt;
+        component.velocity.y += (gravity.y * component.gravityScale + component.force.y * invMass) * dt;
+        component.force = Vec2();
+        auto index = this->BodyOf(q, entity);
+
+        auto &body = this->bodies[index];
+        auto moveX = body.velocity.x * dt, moveY = body.velocity.y * dt;
+        Vec2 pos(body.center.x - body.half.x + std::min(moveX, 0.0f), body.center.y - body.half.y + std::min(moveY, 0.0f));
+        Vec2 size(body.half.x * 2 + std::abs(moveX), body.half.y * 2 + std::abs(moveY));
+        this->hits.clear();
+        this->resting.QueryAABB(pos, size, [&](uint32_t data) {
+            this->hits.push_back(data);
+            return true;
+        });
+        // Hits woken by an earlier one of the same island are paired by the grid below
+        for (auto hit : this->hits) {
+            auto state = this->SlotOf(hit).state;
+            if (state == State::Asleep) {
+                this->Wake(hit);
+            } else if (state == State::Static) {
+                this->pairs.emplace_back(index, this->BodyOf(q, hit));
+            }
+        }
+    }
+
+    // Swept boxes, so that fast bodies meet what lies on their way during this step
+    this->grid.Clear();
+    for (auto entity : this->awake) {
+        auto &body = this->bodies[this->SlotOf(entity).body];
+        auto moveX = body.velocity.x * dt, moveY = body.velocity.y * dt;
+        this->grid.Insert(
+            Vec2(body.center.x - body.half.x + std::min(moveX, 0.0f), body.center.y - body.half.y + std::min(moveY, 0.0f)),
+            Vec2(body.half.x * 2 + std::abs(moveX), body.half.y * 2 + std::abs(moveY))
+        );
+    }
+    this->grid.Pairs(this->gridPairs);
+    for (auto [i, j] : this->gridPairs) {
+        this->pairs.emplace_back(this->SlotOf(this->awake[i]).body, this->SlotOf(this->awake[j]).body);
+    }
+
+    // Pairs sorted by entities come out as sorted contacts, which the merge with the last step relies on
+    for (auto &[x, y] : this->pairs) {
+        if (this->bodies[y].entity < this->bodies[x].entity) {
+            std::swap(x, y);
+        }
+    }
+    std::sort(this->pairs.begin(), this->pairs.end(), [&](const auto &p1, const auto &p2) {
+        auto a1 = this->bodies[p1.first].entity, a2 = this->bodies[p2.first].entity;
+        return a1 != a2 ? a1 < a2 : this->bodies[p1.second].entity < this->bodies[p2.second].entity;
+    });
+    std::swap(this->contacts, this->previous);
+    this->contacts.clear();
+    this->solver.clear();
+    size_t p = 0;
+    for (auto [x, y] : this->pairs) {
+        auto &a = this->bodies[x], &b = this->bodies[y];
+        Contact contact { a.entity, b.entity };
+        if (!Collide(a, b, contact.normal, contact.penetration)) {
+            continue;
+        }
+        // Warm start with what the pair needed last step
+        while (p < this->previous.size() && (this->previous[p].a != a.entity ? this->previous[p].a < a.entity : this->previous[p].b < b.entity)) {
+            p++;
+        }
+        if (p < this->previous.size() && this->previous[p].a == a.entity && this->previous[p].b == b.entity) {
+            contact.normalImpulse = this->previous[p].normalImpulse;
+            contact.tangentImpulse = this->previous[p].tangentImpulse;
+        }
+        auto invMass = a.invMass + b.invMass;
+        auto approach = Dot(Vec2(b.velocity.x - a.velocity.x, b.velocity.y - a.velocity.y), contact.normal);
+        auto bias = this->settings.baumgarte / dt * std::max(contact.penetration - this->settings.slop, 0.0f);
+        if (approach < -1) {
+            bias = std::max(bias, -std::max(a.restitution, b.restitution) * approach);
+        }
+        this->contacts.push_back(contact);
+        this->solver.push_back(SolverContact { x, y, 1 / invMass, bias });
+    }
+
+    // Sequential impulses, bodies only translate so the normal and the tangent share the effective mass
+    auto apply = [&](size_t c, float normalImpulse, float tangentImpulse) {
+        auto &contact = this->contacts[c];
+        auto &a = this->bodies[this->solver[c].bodyA], &b = this->bodies[this->solver[c].bodyB];
+        auto px = contact.normal.x * normalImpulse - contact.normal.y * tangentImpulse;
+        auto py = contact.normal.y * normalImpulse + contact.normal.x * tangentImpulse;
+        a.velocity.x -= px * a.invMass;
+        a.velocity.y -= py * a.invMass;
+        b.velocity.x += px * b.invMass;
+        b.velocity.y += py * b.invMass;
+    };
+    for (size_t c = 0; c < this->contacts.size(); c++) {
+        apply(c, this->contacts[c].normalImpulse, this->contacts[c].tangentImpulse);
+    }
+    for (uint32_t iteration = 0; iteration < this->settings.iterations; iteration++) {
+        for (size_t c = 0; c < this->contacts.size(); c++) {
+            auto &contact = this->contacts[c];
+            auto &solve = this->solver[c];
+            auto &a = this->bodies[solve.bodyA], &b = this->bodies[solve.bodyB];
+            Vec2 relative(b.velocity.x - a.velocity.x, b.velocity.y - a.velocity.y);
+
+            auto normalImpulse = std::max(contact.normalImpulse + solve.mass * (solve.bias - Dot(relative, contact.normal)), 0.0f);
+            auto normalDelta = normalImpulse - contact.normalImpulse;
+            contact.normalImpulse = normalImpulse;
+            apply(c, normalDelta, 0);
+
+            relative = Vec2(b.velocity.x - a.velocity.x, b.velocity.y - a.velocity.y);
+            auto limit = std::sqrt(a.friction * b.friction) * contact.normalImpulse;
+            auto tangentImpulse = std::clamp(contact.tangentImpulse - solve.mass * Dot(relative, Vec2(-contact.normal.y, contact.normal.x)), -limit, limit);
+            auto tangentDelta = tangentImpulse - contact.tangentImpulse;
+            contact.tangentImpulse = tangentImpulse;
+            apply(c, 0, tangentDelta);
+        }
+    }
+
+    // Only awake bodies move, components get the solved velocities
+    auto sleepVelocity2 = this->settings.sleepVelocity * this->settings.sleepVelocity;
+    for (auto entity : this->awake) {
+        auto &slot = this->SlotOf(entity);
+        auto &body = this->bodies[slot.body];
+        body.center.x += body.velocity.x * dt;
+        body.center.y += body.velocity.y * dt;
+        auto &movement = q.Get<Movement>(entity);
+        movement.prevPos = movement.pos;
+        movement.pos = Vec2(body.center.x - body.half.x, body.center.y - body.half.y);
+        q.Get<RigidBody>(entity).velocity = body.velocity;
+        slot.sleepTime = Dot(body.velocity, body.velocity) < sleepVelocity2 ? slot.sleepTime + dt : 0;
+    }
+
+    // Awake bodies in contact form islands, static bodies do not join them. An island sleeps once
+    // its most restless body has been slow for long enough
+    auto count = this->awake.size();
+    this->parents.resize(count);
+    std::iota(this->parents.begin(), this->parents.end(), 0);
+    for (auto &contact : this->contacts) {
+        auto &a = this->SlotOf(contact.a), &b = this->SlotOf(contact.b);
+        if (a.state == State::Awake && b.state == State::Awake) {
+            this->parents[this->Find(a.index)] = this->Find(b.index);
+        }
+    }
+    this->islandSleep.assign(count, std::numeric_limits<float>::max());
+    for (size_t i = 0; i < count; i++) {
+        auto root = this->Find(i);
+        this->islandSleep[root] = std::min(this->islandSleep[root], this->SlotOf(this->awake[i]).sleepTime);
+    }
+    this->sleepers.clear();
+    for (size_t i = 0; i < count; i++) {
+        auto root = this->Find(i);
+        if (this->islandSleep[root] >= this->settings.timeToSleep) {
+            this->sleepers.emplace_back(root, this->awake[i]);
+        }
+    }
+    std::sort(this->sleepers.begin(), this->sleepers.end());
+    for (size_t begin = 0; begin < this->sleepers.size();) {
+        auto end = begin;
+        this->members.clear();
+        while (end < this->sleepers.size() && this->sleepers[end].first == this->sleepers[begin].first) {
+            this->members.push_back(this->sleepers[end++].second);
+        }
+        this->Sleep(q, this->members);
+        begin = end;
+    }
+}
+
+void engine::physics::PhysicsSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
+    if (r.Has<PhysicsWorld>()) {
+        r.Get<PhysicsWorld>().Step(q, StepDelta(r));
+    }
+}
+
+void engine::physics::AddPhysics(ecs::World &world, const PhysicsSettings &settings) {
+    PhysicsWorld physics;
+    physics.settings = settings;
+    world.SetResource(std::move(physics));
+    world.OnAdd<RigidBody>([](ecs::World &world, std::span<const ecs::Entity> entities) {
+        auto &physics = ecs::Resources(world).Get<PhysicsWorld>();
+        for (auto entity : entities) {
+            physics.Track(entity);
+        }
+    });
+    world.OnReplace<RigidBody>([](ecs::World &world, std::span<const ecs::Entity> entities) {
+        auto &physics = ecs::Resources(world).Get<PhysicsWorld>();
+        ecs::Querier q(world);
+        for (auto entity : entities) {
+            physics.Refresh(entity, q.Get<const RigidBody>(entity));
+        }
+    });
+    world.OnRemove<RigidBody>([](ecs::World &world, std::span<const ecs::Entity> entities) {
+        auto &physics = ecs::Resources(world).Get<PhysicsWorld>();
+        for (auto entity : entities) {
+            physics.Untrack(entity);
+        }
+    });
+    // A body losing its Movement goes back to waiting for one
+    world.OnRemove<Movement>([](ecs::World &world, std::span<const ecs::Entity> entities) {
+        auto &physics = ecs::Resources(world).Get<PhysicsWorld>();
+        ecs::Querier q(world);
+        for (auto entity : entities) {
+            if (q.Has<RigidBody>(entity)) {
+                physics.Untrack(entity);
+                physics.Track(entity);
+            }
+        }
+    });
+    world.AddSystem(PhysicsSystem, ecs::SystemAccess().Write<RigidBody>().Write<Movement>().WriteResource<PhysicsWorld>().ReadResource<ecs::Time>(), "physics");
+}
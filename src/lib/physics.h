@@ -0,0 +1,151 @@
+#pragma once
+#include "components.h"
+#include <span>
+
+
+namespace engine {
+    namespace physics {
+        enum class Shape : uint8_t {
+            Box, Circle
+        };
+
+        // Body moved by PhysicsSystem, its bounding box starts at the entity's Movement::pos. Bodies only
+        // translate, MovementSystem skips entities with a RigidBody
+        struct RigidBody {
+            Shape shape = Shape::Box;
+            // Extents of a box, circles take `size.x` as their diameter
+            Vec2 size;
+            Vec2 velocity;
+            // Accumulated until the next step, which clears it
+            Vec2 force;
+            // Bodies without mass are static
+            float mass = 1;
+            float restitution = 0;
+            float friction = 0.3f;
+            float gravityScale = 1;
+        };
+
+        struct PhysicsSettings {
+            Vec2 gravity = Vec2(0, 980);
+            // Tall stacks need more solver iterations to come to rest
+            uint32_t iterations = 8;
+            // Share of the penetration beyond `slop` pushed out per step
+            float baumgarte = 0.2f;
+            float slop = 0.5f;
+            // Islands whose bodies all stay slower than `sleepVelocity` for `timeToSleep` seconds go to sleep
+            float sleepVelocity = 8;
+            float timeToSleep = 0.5f;
+            float cellSize = 64;
+        };
+
+        // Touching pair of the last step, `a` being the smaller handle and `normal` pointing from a to b.
+        // The accumulated impulses carry over to the next step when the pair still touches
+        struct Contact {
+            ecs::Entity a;
+            ecs::Entity b;
+            Vec2 normal;
+            float penetration;
+            float normalImpulse = 0;
+            float tangentImpulse = 0;
+        };
+
+        // Simulation state, set up as a resource by AddPhysics. A step only visits awake bodies, sleeping and
+        // static ones wait in a tree until an awake body comes close, which wakes the whole sleeping island
+        class PhysicsWorld final {
+        public:
+            PhysicsSettings settings;
+
+            void Step(ecs::Querier &q, float dt);
+
+            // Bodies are picked up by the next step, the observers AddPhysics registers call these. A body
+            // tracked before it has a Movement waits for one
+            void Track(ecs::Entity entity);
+            void Untrack(ecs::Entity entity);
+            // For a replaced RigidBody, a body that gained or lost its mass switches between static and dynamic
+            void Refresh(ecs::Entity entity, const RigidBody &body);
+
+            // Needed after moving a sleeping body or pushing it from outside the simulation
+            void Wake(ecs::Entity entity);
+            bool IsAwake(ecs::Entity entity) const;
+            size_t GetAwakeCount() const { return this->awake.size(); }
+            size_t GetRestingCount() const { return this->resting.Size(); }
+            std::span<const Contact> GetContacts() const { return this->contacts; }
+
+        private:
+            enum class State : uint8_t {
+                None, Awake, Asleep, Static
+            };
+
+            // `index` is the position in `awake` of an awake body and the island of a sleeping one
+            struct Slot {
+                ecs::Entity entity = ecs::EntityTraits::null;
+                State state = State::None;
+                uint32_t index = 0;
+                int32_t proxy = AABBTree::null;
+                float sleepTime = 0;
+                // Step in which `body` was assigned
+                uint32_t step = 0;
+                uint32_t body = 0;
+            };
+
+            // Copy of a body for the solver, Slot::body points at it during a step
+            struct Body {
+                ecs::Entity entity;
+                Vec2 center;
+                Vec2 half;
+                Vec2 velocity;
+                float invMass;
+                float restitution;
+                float friction;
+                Shape shape;
+            };
+
+            struct SolverContact {
+                uint32_t bodyA;
+                uint32_t bodyB;
+                float mass;
+                float bias;
+            };
+
+            // Indexed by entity index
+            std::vector<Slot> slots;
+            std::vector<ecs::Entity> awake;
+            std::vector<ecs::Entity> pending;
+            // Members of every sleeping island, by island id
+            std::vector<std::vector<ecs::Entity>> islands;
+            std::vector<uint32_t> freeIslands;
+            // Exact boxes of sleeping and static bodies, they never move while in the tree
+            AABBTree resting = AABBTree(0);
+            // Swept boxes of awake bodies, refilled every step
+            SpatialHash grid;
+            uint32_t stepCount = 0;
+
+            // Scratch kept across steps so that they stop allocating
+            std::vector<Body> bodies;
+            std::vector<std::pair<uint32_t, uint32_t>> pairs;
+            std::vector<std::pair<uint32_t, uint32_t>> gridPairs;
+            std::vector<Contact> contacts;
+            std::vector<Contact> previous;
+            std::vector<SolverContact> solver;
+            std::vector<ecs::Entity> hits;
+            std::vector<uint32_t> parents;
+            std::vector<float> islandSleep;
+            // Island root and entity of the bodies going to sleep
+            std::vector<std::pair<uint32_t, ecs::Entity>> sleepers;
+            std::vector<ecs::Entity> members;
+
+            Slot &SlotOf(ecs::Entity entity);
+            void AddAwake(ecs::Entity entity);
+            void RemoveAwake(ecs::Entity entity);
+            uint32_t BodyOf(ecs::Querier &q, ecs::Entity entity);
+            void Sleep(ecs::Querier &q, std::span<const ecs::Entity> members);
+            uint32_t Find(uint32_t body);
+        };
+
+        void PhysicsSystem(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e);
+
+        // Sets the PhysicsWorld resource up, registers PhysicsSystem and the observers that keep it
+        // informed of added, replaced and removed bodies and of bodies losing their Movement
+        void AddPhysics(ecs::World &world, const PhysicsSettings &settings = {});
+    }
+}
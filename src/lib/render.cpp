@@ -21,6 +21,7 @@ int Renderer::globalFontSize;
 TTF_Font *Renderer::globalFont;
 int Renderer::currentFontSlot;
 bool Renderer::showFPSCounter;
+bool Renderer::frameCap = true;
 float Renderer::fpsQueryFreq;
 bool Renderer::profiling;
 float Renderer::profilingFreq;
@@ -179,7 +180,7 @@ void Renderer::Update() {
 
     SDL_RenderPresent(Renderer::renderer);
     Renderer::prevFrameDeltatime = (SDL_GetPerformanceCounter() - Renderer::ticks) / (float) (SDL_GetPerformanceFrequency());
-    if (prevFrameDeltatime < 1.0f / MAX_FRAMERATE) {
+    if (Renderer::frameCap && prevFrameDeltatime < 1.0f / MAX_FRAMERATE) {
         SDL_Delay((Uint32) (1000 * (1.0f / MAX_FRAMERATE - prevFrameDeltatime)));
         Renderer::prevFrameDeltatime += (1.0f / MAX_FRAMERATE - prevFrameDeltatime);
     }
@@ -1230,6 +1231,10 @@ void Renderer::DisableFPSCounter() {
     Renderer::showFPSCounter = false;
 }
 
+void Renderer::SetFrameCap(bool enabled) {
+    Renderer::frameCap = enabled;
+}
+
 
 void Renderer::BoxBlur(SDL_Surface *src, SDL_Surface *dst, int radius) {
     int width = src->w;
@@ -315,6 +315,9 @@ namespace engine {
 
         static Uint64 GetTicks();
         static void EnableFPSCounter(float fpsQueryFreq = 0.32f);
+        // Update sleeps to hold MAX_FRAMERATE. Turning it off renders as often as possible, which keeps a
+        // core busy, a world stepped at a fixed timestep interpolates between its updates either way
+        static void SetFrameCap(bool enabled);
         static void DisableFPSCounter();
         static void EnableProfiling(const std::string &file, float sampleFreq = 0.32f);
         static void Sample();
@@ -355,6 +358,7 @@ namespace engine {
         static std::vector<TTF_Font *> fontSlot;
         static int currentFontSlot;
         static bool showFPSCounter;
+        static bool frameCap;
         static float fpsQueryFreq;
         static bool profiling;
         static float profilingFreq;
@@ -86,6 +86,12 @@ void SceneManager::AddScene(const std::string &name, Scene *scene) {
     }
 }
 
+SceneID SceneManager::GetSceneID(const std::string &name) {
+    std::lock_guard lock(sceneIDMutex);
+    auto [it, _] = sceneIDs.emplace(name, (SceneID) sceneIDs.size());
+    return it->second;
+}
+
 Scene *SceneManager::GetCurrentScene() {
     if (!scenes.empty() && scenes.find(currentScene) != scenes.end()) {
         return scenes[currentScene];
@@ -110,6 +116,7 @@ void SceneManager::SwitchScene(const std::string &name) {
 
     if (scenes.find(name) != scenes.end()) {
         currentScene = name;
+        currentSceneID = GetSceneID(name);
         s = GetCurrentScene();
         s->Enter();
         DEBUG_F("Switched to scene `{}`", name);
@@ -2,11 +2,14 @@
 
 #include <string>
 #include <map>
+#include <mutex>
 #include "object.h"
 #include "ecs.h"
 #include "log.h"
 
 namespace engine {
+    // Interned scene name, "none" is always 0
+    using SceneID = uint32_t;
 
     class Scene {
     public:
@@ -48,7 +51,10 @@ namespace engine {
     public:
         static void Initialize();
 
-        inline static std::string GetCurrentSceneName() { return currentScene; }
+        inline static const std::string &GetCurrentSceneName() { return currentScene; }
+        inline static SceneID GetCurrentSceneID() { return currentSceneID; }
+        // Same name, same id, whether or not the scene has been added yet
+        static SceneID GetSceneID(const std::string &sceneName);
         inline int static GetSceneCount() { return scenes.size(); }
         static void AddScene(const std::string &sceneName, Scene *scene);
         static void SwitchScene(const std::string &sceneName);
@@ -67,7 +73,11 @@ namespace engine {
 
     private:
         static inline std::string currentScene = "none";
+        static inline SceneID currentSceneID = 0;
         static std::map<std::string, Scene *> scenes;
+        // Components may be recorded on worker threads, so interning is locked
+        static inline std::map<std::string, SceneID> sceneIDs = { { "none", 0 } };
+        static inline std::mutex sceneIDMutex;
 
         // TODO: implement shared objects
         static std::vector<std::string, GameObjectBase *> sharedObjects;
@@ -1,5 +1,49 @@
 #include "utils.hpp"
 #include <SDL.h>
+#include <algorithm>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+static void IntegrateScalar(float *x, float *y, const float *velocityX, const float *velocityY, size_t count, float dt) {
+    for (size_t i = 0; i < count; i++) {
+        x[i] += (float) (int) (velocityX[i] * dt);
+        y[i] += (float) (int) (velocityY[i] * dt);
+    }
+}
+
+#ifdef HAS_X86_KERNELS
+// Both kernels truncate with cvttps like the scalar casts do, and return how many elements they handled
+__attribute__((target("sse2")))
+static size_t IntegrateSSE2(float *x, float *y, const float *velocityX, const float *velocityY, size_t count, float dt) {
+    auto step = _mm_set1_ps(dt);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto moveX = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(velocityX + i), step)));
+        auto moveY = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(velocityY + i), step)));
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), moveX));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), moveY));
+    }
+    return i;
+}
+
+// The 256-bit float conversions are already part of AVX, AVX2 would only add integer lanes
+__attribute__((target("avx")))
+static size_t IntegrateAVX(float *x, float *y, const float *velocityX, const float *velocityY, size_t count, float dt) {
+    auto step = _mm256_set1_ps(dt);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto moveX = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(velocityX + i), step)));
+        auto moveY = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(velocityY + i), step)));
+        _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), moveX));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), moveY));
+    }
+    return i;
+}
+#endif
 
 
 namespace engine {
@@ -73,6 +117,10 @@ namespace engine {
         return r;
     }
 
+    Vec2 Vec2::Lerp(const Vec2 &a, const Vec2 &b, float t) {
+        return Vec2(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t);
+    }
+
     Vec2 Vec2::Rotate(const Vec2 &v, float angle) {
         float rad = DEG_TO_RAD(angle);
         return Vec2(
@@ -112,140 +160,358 @@ namespace engine {
     }
 
 
-    /*QuadTree::QuadTree(int pLevel, const Vec2 &boundPos, const Vec2 &boundSize) {
-        this->level = pLevel;
-        this->pos = boundPos;
-        this->size = boundSize;
-        this->objects = {};
-        this->children = { nullptr, nullptr, nullptr, nullptr };
+    SpatialHash::SpatialHash(float cellSize) : cellSize(cellSize) {
+        assert(cellSize > 0 && "Cell size must be positive");
+    }
+
+    void SpatialHash::Clear() {
+        this->boxes.clear();
+        this->entries.clear();
     }
 
-    void QuadTree::Clear() {
-        this->objects.clear();
-        for (auto &child : this->children) {
-            if (child) {
-                child->Clear();
-                child = nullptr;
+    uint32_t SpatialHash::Insert(const Vec2 &pos, const Vec2 &size) {
+        auto id = (uint32_t) this->boxes.size();
+        Box box { pos.x, pos.y, pos.x + size.x, pos.y + size.y };
+        this->boxes.push_back(box);
+        for (auto cy = this->Cell(box.y0); cy <= this->Cell(box.y1); cy++) {
+            for (auto cx = this->Cell(box.x0); cx <= this->Cell(box.x1); cx++) {
+                this->entries.push_back(Entry { cx, cy, id });
             }
         }
+        return id;
     }
 
-    std::vector<int> QuadTree::GetIndexes(const Vec2 &rectPos, const Vec2 &rectSize) {
-        std::vector<int> indexes;
+    void SpatialHash::Pairs(std::vector<std::pair<uint32_t, uint32_t>> &out) {
+        out.clear();
+        // Counting sort of the entries into a power of two table about twice their count
+        size_t bucketCount = 1;
+        while (bucketCount < this->entries.size() * 2) {
+            bucketCount *= 2;
+        }
+        this->starts.assign(bucketCount + 1, 0);
+        for (auto &entry : this->entries) {
+            this->starts[this->Bucket(entry, bucketCount) + 1]++;
+        }
+        for (size_t i = 0; i < bucketCount; i++) {
+            this->starts[i + 1] += this->starts[i];
+        }
+        this->sorted.resize(this->entries.size());
+        this->cursors.assign(this->starts.begin(), this->starts.end() - 1);
+        for (auto &entry : this->entries) {
+            this->sorted[this->cursors[this->Bucket(entry, bucketCount)]++] = entry;
+        }
 
-        Vec2 midPoint = this->pos + this->size * 0.5;
+        for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+            for (auto i = this->starts[bucket]; i < this->starts[bucket + 1]; i++) {
+                auto &a = this->sorted[i];
+                auto &boxA = this->boxes[a.box];
+                for (auto j = i + 1; j < this->starts[bucket + 1]; j++) {
+                    auto &b = this->sorted[j];
+                    // Other cells may hash into the same bucket
+                    if (a.cx != b.cx || a.cy != b.cy) {
+                        continue;
+                    }
+                    auto &boxB = this->boxes[b.box];
+                    auto left = std::max(boxA.x0, boxB.x0);
+                    auto top = std::max(boxA.y0, boxB.y0);
+                    if (left >= std::min(boxA.x1, boxB.x1) || top >= std::min(boxA.y1, boxB.y1)) {
+                        continue;
+                    }
+                    // Boxes sharing several cells overlap in all of them, only the one
+                    // holding the top-left corner of the overlap reports the pair
+                    if (this->Cell(left) == a.cx && this->Cell(top) == a.cy) {
+                        out.emplace_back(std::min(a.box, b.box), std::max(a.box, b.box));
+                    }
+                }
+            }
+        }
+    }
 
-        bool topQuadrant = rectPos.y >= midPoint.y;
-        bool bottomQuadrant = (rectPos.y - rectSize.y) <= midPoint.y;
-        bool topAndBottomQuadrant = rectPos.y + rectSize.y + 1 >= midPoint.y && rectPos.y + 1 <= midPoint.y;
+    int32_t SpatialHash::Cell(float coord) const {
+        return (int32_t) std::floor(coord / this->cellSize);
+    }
 
-        if (topAndBottomQuadrant) {
-            topQuadrant = false;
-            bottomQuadrant = false;
-        }
+    size_t SpatialHash::Bucket(const Entry &entry, size_t bucketCount) {
+        return (((uint32_t) entry.cx * 73856093u) ^ ((uint32_t) entry.cy * 19349663u)) & (bucketCount - 1);
+    }
 
-        if (rectPos.x + rectSize.x + 1 >= midPoint.x && rectPos.x - 1 <= midPoint.x) {
-            if (topQuadrant) {
-                indexes.push_back(2);
-                indexes.push_back(3);
-            } else if (bottomQuadrant) {
-                indexes.push_back(0);
-                indexes.push_back(1);
-            } else if (topAndBottomQuadrant) {
-                indexes.push_back(0);
-                indexes.push_back(1);
-                indexes.push_back(2);
-                indexes.push_back(3);
+    AABBTree::AABBTree(float margin) : margin(margin) {}
+
+    float AABBTree::Box::Distance2(float x, float y) const {
+        auto dx = std::max({ this->x0 - x, 0.0f, x - this->x1 });
+        auto dy = std::max({ this->y0 - y, 0.0f, y - this->y1 });
+        return dx * dx + dy * dy;
+    }
+
+    // Slab test, `distance` is where the ray enters the box (0 when it starts inside)
+    bool AABBTree::Box::Intersects(const Vec2 &origin, const Vec2 &direction, float maxDistance, float &distance) const {
+        float near = 0, far = maxDistance;
+        const float lower[2] = { this->x0, this->y0 }, upper[2] = { this->x1, this->y1 };
+        const float from[2] = { origin.x, origin.y }, dir[2] = { direction.x, direction.y };
+        for (int axis = 0; axis < 2; axis++) {
+            if (dir[axis] == 0) {
+                if (from[axis] < lower[axis] || from[axis] > upper[axis]) {
+                    return false;
+                }
+                continue;
             }
-        } else if (rectPos.x + 1 >= midPoint.x) {
-            if (topQuadrant) {
-                indexes.push_back(3);
-            } else if (bottomQuadrant) {
-                indexes.push_back(0);
-            } else if (topAndBottomQuadrant) {
-                indexes.push_back(3);
-                indexes.push_back(0);
+            auto t0 = (lower[axis] - from[axis]) / dir[axis];
+            auto t1 = (upper[axis] - from[axis]) / dir[axis];
+            near = std::max(near, std::min(t0, t1));
+            far = std::min(far, std::max(t0, t1));
+            if (near > far) {
+                return false;
             }
-        } else if (rectPos.x - rectSize.x <= midPoint.x) {
-            if (topQuadrant) {
-                indexes.push_back(2);
-            } else if (bottomQuadrant) {
-                indexes.push_back(1);
-            } else if (topAndBottomQuadrant) {
-                indexes.push_back(2);
-                indexes.push_back(1);
+        }
+        distance = near;
+        return true;
+    }
+
+    AABBTree::Box AABBTree::Box::Union(const Box &a, const Box &b) {
+        return Box { std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+    }
+
+    int32_t AABBTree::Insert(const Vec2 &pos, const Vec2 &size, uint32_t data) {
+        auto leaf = this->AllocateNode();
+        auto &node = this->nodes[leaf];
+        node.tight = Box { pos.x, pos.y, pos.x + size.x, pos.y + size.y };
+        node.box = Box { node.tight.x0 - this->margin, node.tight.y0 - this->margin, node.tight.x1 + this->margin, node.tight.y1 + this->margin };
+        node.data = data;
+        this->InsertLeaf(leaf);
+        this->leafCount++;
+        return leaf;
+    }
+
+    void AABBTree::Remove(int32_t proxy) {
+        assert(this->nodes[proxy].IsLeaf() && "Not a proxy of the tree");
+        this->RemoveLeaf(proxy);
+        this->FreeNode(proxy);
+        this->leafCount--;
+    }
+
+    bool AABBTree::Move(int32_t proxy, const Vec2 &pos, const Vec2 &size) {
+        auto &node = this->nodes[proxy];
+        node.tight = Box { pos.x, pos.y, pos.x + size.x, pos.y + size.y };
+        if (node.box.Contains(node.tight)) {
+            return false;
+        }
+        this->RemoveLeaf(proxy);
+        auto &moved = this->nodes[proxy];
+        moved.box = Box { moved.tight.x0 - this->margin, moved.tight.y0 - this->margin, moved.tight.x1 + this->margin, moved.tight.y1 + this->margin };
+        this->InsertLeaf(proxy);
+        return true;
+    }
+
+    void AABBTree::Clear() {
+        this->nodes.clear();
+        this->root = null;
+        this->freeList = null;
+        this->leafCount = 0;
+    }
+
+    int32_t AABBTree::AllocateNode() {
+        if (this->freeList == null) {
+            this->nodes.emplace_back();
+            return (int32_t) this->nodes.size() - 1;
+        }
+        auto index = this->freeList;
+        this->freeList = this->nodes[index].parent;
+        this->nodes[index] = Node {};
+        return index;
+    }
+
+    void AABBTree::FreeNode(int32_t index) {
+        this->nodes[index].parent = this->freeList;
+        this->nodes[index].height = -1;
+        this->freeList = index;
+    }
+
+    // Walks down to the sibling whose union with the leaf grows the perimeters the least
+    void AABBTree::InsertLeaf(int32_t leaf) {
+        if (this->root == null) {
+            this->root = leaf;
+            this->nodes[leaf].parent = null;
+            return;
+        }
+
+        auto box = this->nodes[leaf].box;
+        auto sibling = this->root;
+        while (!this->nodes[sibling].IsLeaf()) {
+            auto &node = this->nodes[sibling];
+            auto area = node.box.Perimeter();
+            auto combined = Box::Union(node.box, box).Perimeter();
+            // Cost of pairing the leaf with this node, and the least cost pushed down to the children
+            auto cost = 2 * combined;
+            auto inherited = 2 * (combined - area);
+            auto descend = [&](int32_t child) {
+                auto &c = this->nodes[child];
+                auto grown = Box::Union(box, c.box).Perimeter();
+                return c.IsLeaf() ? grown + inherited : grown - c.box.Perimeter() + inherited;
+            };
+            auto costLeft = descend(node.left);
+            auto costRight = descend(node.right);
+            if (cost < costLeft && cost < costRight) {
+                break;
             }
+            sibling = costLeft < costRight ? node.left : node.right;
+        }
+
+        auto oldParent = this->nodes[sibling].parent;
+        auto newParent = this->AllocateNode();
+        auto &parent = this->nodes[newParent];
+        parent.parent = oldParent;
+        parent.box = Box::Union(box, this->nodes[sibling].box);
+        parent.height = this->nodes[sibling].height + 1;
+        parent.left = sibling;
+        parent.right = leaf;
+        this->nodes[sibling].parent = newParent;
+        this->nodes[leaf].parent = newParent;
+        if (oldParent == null) {
+            this->root = newParent;
+        } else if (this->nodes[oldParent].left == sibling) {
+            this->nodes[oldParent].left = newParent;
         } else {
-            indexes.push_back(-1);
+            this->nodes[oldParent].right = newParent;
         }
-        return indexes;
-    }
-
-    void QuadTree::Split() {
-        int subWidth =  this->size.x / 2;
-        int subHeight = this->size.y / 2;
-        int x = this->pos.x;
-        int y = this->pos.y;
-        
-        this->children[0] = new QuadTree(level + 1, Vec2(x + subWidth, y), Vec2(subWidth, subHeight));
-        this->children[1] = new QuadTree(level + 1, Vec2(x, y), Vec2(subWidth, subHeight));
-        this->children[2] = new QuadTree(level + 1, Vec2(x, y + subHeight), Vec2(subWidth, subHeight));
-        this->children[3] = new QuadTree(level + 1, Vec2(x + subWidth, y + subHeight), Vec2(subWidth, subHeight));
-    }
-
-    void QuadTree::Insert(const ObjectWithRect &object, const Vec2 &objectPos, const Vec2 &objectSize) {
-        if (this->children[0]) {
-            auto indexes = this->GetIndexes(objectPos, objectSize);
-
-            for (int ii = 0; ii < indexes.size(); ii++) {
-                int index = indexes[ii];
-                if (index != -1) {
-                    this->children[index]->Insert(object, objectPos, objectSize);
-                    return;
-                }
-            }
+        this->Refit(newParent);
+    }
+
+    void AABBTree::RemoveLeaf(int32_t leaf) {
+        if (leaf == this->root) {
+            this->root = null;
+            return;
         }
-        
-        this->objects.push_back(object);
-        
-        if (this->objects.size() > this->maxObjects && this->level < this->maxLevels) {
-            if (!this->children[0]) {
-                this->Split();
-            }
-            
-            int i = 0;
-            while (i < objects.size()) {
-                auto obj = objects[i];
-                auto indexes = GetIndexes(obj.pos, obj.size);
-                for (int ii = 0; ii < indexes.size(); ii++) {
-                    int index = indexes[ii];
-                    if (index != -1) {
-                        this->children[index]->Insert(obj, obj.pos, obj.size);
-                        objects.erase(objects.begin() + i);
-                    } else {
-                        i++;
-                    }
-                }
-            }
+        auto parent = this->nodes[leaf].parent;
+        auto grandParent = this->nodes[parent].parent;
+        auto sibling = this->nodes[parent].left == leaf ? this->nodes[parent].right : this->nodes[parent].left;
+        this->FreeNode(parent);
+        if (grandParent == null) {
+            this->root = sibling;
+            this->nodes[sibling].parent = null;
+            return;
         }
+        if (this->nodes[grandParent].left == parent) {
+            this->nodes[grandParent].left = sibling;
+        } else {
+            this->nodes[grandParent].right = sibling;
+        }
+        this->nodes[sibling].parent = grandParent;
+        this->Refit(grandParent);
     }
 
-    std::vector<QuadTree::ObjectWithRect> QuadTree::Retrieve(std::vector<ObjectWithRect > &result, const Vec2 &rectPos, const Vec2 &rectSize) {
-        auto indexes = GetIndexes(rectPos, rectSize);
+    // Fixes boxes and heights from `index` up to the root, rotating where the children are unbalanced
+    void AABBTree::Refit(int32_t index) {
+        while (index != null) {
+            index = this->Balance(index);
+            auto &node = this->nodes[index];
+            node.height = 1 + std::max(this->nodes[node.left].height, this->nodes[node.right].height);
+            node.box = Box::Union(this->nodes[node.left].box, this->nodes[node.right].box);
+            index = node.parent;
+        }
+    }
+
+    // Promotes a grandchild when one subtree is two levels deeper than the other, returns the node
+    // now standing where `a` stood
+    int32_t AABBTree::Balance(int32_t a) {
+        auto &nodeA = this->nodes[a];
+        if (nodeA.IsLeaf() || nodeA.height < 2) {
+            return a;
+        }
+        auto b = nodeA.left;
+        auto c = nodeA.right;
+        auto balance = this->nodes[c].height - this->nodes[b].height;
+        if (balance >= -1 && balance <= 1) {
+            return a;
+        }
+
+        // `up` is the deeper child, its deeper child stays below it and the other one swaps with `a`'s other child
+        auto up = balance > 1 ? c : b;
+        auto other = balance > 1 ? b : c;
+        auto &nodeUp = this->nodes[up];
+        auto f = nodeUp.left;
+        auto g = nodeUp.right;
+
+        nodeUp.left = a;
+        nodeUp.parent = nodeA.parent;
+        nodeA.parent = up;
+        if (nodeUp.parent == null) {
+            this->root = up;
+        } else if (this->nodes[nodeUp.parent].left == a) {
+            this->nodes[nodeUp.parent].left = up;
+        } else {
+            this->nodes[nodeUp.parent].right = up;
+        }
+
+        auto keep = this->nodes[f].height > this->nodes[g].height ? f : g;
+        auto swap = keep == f ? g : f;
+        nodeUp.right = keep;
+        if (balance > 1) {
+            nodeA.right = swap;
+        } else {
+            nodeA.left = swap;
+        }
+        this->nodes[swap].parent = a;
+        nodeA.box = Box::Union(this->nodes[other].box, this->nodes[swap].box);
+        nodeUp.box = Box::Union(nodeA.box, this->nodes[keep].box);
+        nodeA.height = 1 + std::max(this->nodes[other].height, this->nodes[swap].height);
+        nodeUp.height = 1 + std::max(nodeA.height, this->nodes[keep].height);
+        return up;
+    }
 
-        for(int ii = 0; ii < indexes.size(); ii++) {
-            int index = indexes[ii];
-            if (index != -1 && this->children[0]) {
-                this->children[index]->Retrieve(result, rectPos, rectSize);
-            }    
-                
-            for (auto o : this->objects) {
-                result.emplace_back(o);
+    SimdLevel GetSimdLevel() {
+        static const SimdLevel level = []() {
+        #ifdef HAS_X86_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx")) {
+                return SimdLevel::AVX;
             }
+            if (__builtin_cpu_supports("sse2")) {
+                return SimdLevel::SSE2;
+            }
+        #endif
+            return SimdLevel::Scalar;
+        }();
+        return level;
+    }
+
+    const char *GetSimdLevelName(SimdLevel level) {
+        switch (level) {
+            case SimdLevel::AVX:
+                return "avx";
+            case SimdLevel::SSE2:
+                return "sse2";
+            default:
+                return "scalar";
+        }
+    }
+
+    void IntegrateMotion(float *x, float *y, const float *velocityX, const float *velocityY, size_t count, float dt, SimdLevel level) {
+        size_t done = 0;
+    #ifdef HAS_X86_KERNELS
+        switch (std::min(level, GetSimdLevel())) {
+            case SimdLevel::AVX:
+                done = IntegrateAVX(x, y, velocityX, velocityY, count, dt);
+                break;
+            case SimdLevel::SSE2:
+                done = IntegrateSSE2(x, y, velocityX, velocityY, count, dt);
+                break;
+            default:
+                break;
         }
-        
-        return result;
-    }*/
+    #endif
+        IntegrateScalar(x + done, y + done, velocityX + done, velocityY + done, count - done, dt);
+    }
+
+    void MotionArrays::Resize(size_t count) {
+        this->x.resize(count);
+        this->y.resize(count);
+        this->velocityX.resize(count);
+        this->velocityY.resize(count);
+    }
+
+    void MotionArrays::Integrate(float dt, SimdLevel level) {
+        IntegrateMotion(this->x.data(), this->y.data(), this->velocityX.data(), this->velocityY.data(), this->Size(), dt, level);
+    }
 
     float Vec2::Angle(const Vec2 &v) {
         float d = atan2(v.y, v.x) * 180 / PI;
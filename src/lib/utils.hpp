@@ -9,6 +9,9 @@
 #include <vector>
 #include <map>
 #include <sstream>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
 
 #define SRAND() srand((unsigned) time(nullptr))
 
@@ -43,38 +46,226 @@ namespace engine {
         }
 
         static Vec2 Rotate(const Vec2 &v, float angle);
+        // Unlike operator*, keeps the fraction
+        static Vec2 Lerp(const Vec2 &a, const Vec2 &b, float t);
         static SDL_Rect CreateRect(const Vec2 &a, const Vec2 &b);
         static SDL_FRect CreateFRect(const Vec2 &a, const Vec2 &b);
         static float Angle(const Vec2 &v);
         static float Angle(const Vec2 &v1, const Vec2 &v2);
     };
 
-    struct QuadTree final {
-        struct ObjectWithRect {
-            std::string id;
-            void *object;
-            Vec2 pos;
-            Vec2 size;
+    // Uniform grid broad phase for boxes, with the cells hashed into a table sized to the content.
+    // Cleared and refilled every frame, which is cheaper than tracking moves for boxes that all move
+    class SpatialHash final {
+    public:
+        explicit SpatialHash(float cellSize = 64);
+
+        void Clear();
+        // `pos` is the top-left corner, returns the id of the box, ids count up from 0 after a Clear
+        uint32_t Insert(const Vec2 &pos, const Vec2 &size);
+        // Fills `out` with every pair of overlapping boxes, exactly once and with the smaller id first
+        void Pairs(std::vector<std::pair<uint32_t, uint32_t>> &out);
+
+        size_t Size() const { return this->boxes.size(); }
+        float GetCellSize() const { return this->cellSize; }
+
+    private:
+        struct Box {
+            float x0, y0, x1, y1;
+        };
+
+        // One per cell a box covers
+        struct Entry {
+            int32_t cx, cy;
+            uint32_t box;
         };
 
-        void* _placeholder;
+        float cellSize;
+        std::vector<Box> boxes;
+        std::vector<Entry> entries;
+        // Kept across frames so that the table stops allocating
+        std::vector<Entry> sorted;
+        std::vector<size_t> starts;
+        std::vector<size_t> cursors;
 
-        /*std::vector<ObjectWithRect> objects;
-        std::array<QuadTree *, 4> children;
-        int level;
-        Vec2 pos;
-        Vec2 size;
+        int32_t Cell(float coord) const;
+        static size_t Bucket(const Entry &entry, size_t bucketCount);
+    };
+
+    // Dynamic bounding volume tree over boxes for queries that hit few of them. Leaves keep a box
+    // fattened by `margin`, moves that stay inside it cost a containment check and nothing else
+    class AABBTree final {
+    public:
+        static constexpr int32_t null = -1;
 
-        const int maxObjects = 1;
-        const int maxLevels = 5;
+        explicit AABBTree(float margin = 8);
 
-        QuadTree(int pLevel, const Vec2 &boundPos, const Vec2 &boundSize);
+        // `pos` is the top-left corner, `data` is handed back by the queries
+        int32_t Insert(const Vec2 &pos, const Vec2 &size, uint32_t data);
+        void Remove(int32_t proxy);
+        // Returns true when the box left its fattened bounds and the leaf was reinserted
+        bool Move(int32_t proxy, const Vec2 &pos, const Vec2 &size);
         void Clear();
-        std::vector<int> GetIndexes(const Vec2 &rectPos, const Vec2 &rectSize);
-        void Insert(const ObjectWithRect &object, const Vec2 &objectPos, const Vec2 &objectSize);
-        void Split();
-        std::vector<ObjectWithRect> Retrieve(std::vector<ObjectWithRect> &result, const Vec2 &rectPos, const Vec2 &rectSize);*/
-    };  
+
+        uint32_t GetData(int32_t proxy) const { return this->nodes[proxy].data; }
+        Vec2 GetPos(int32_t proxy) const { return Vec2(this->nodes[proxy].tight.x0, this->nodes[proxy].tight.y0); }
+        Vec2 GetSize(int32_t proxy) const {
+            auto &box = this->nodes[proxy].tight;
+            return Vec2(box.x1 - box.x0, box.y1 - box.y0);
+        }
+        size_t Size() const { return this->leafCount; }
+        int32_t GetHeight() const { return this->root == null ? 0 : this->nodes[this->root].height; }
+
+        // Calls func(data) for every box overlapping the rectangle until func returns false
+        template<typename Func>
+        void QueryAABB(const Vec2 &pos, const Vec2 &size, Func &&func) const {
+            Box query { pos.x, pos.y, pos.x + size.x, pos.y + size.y };
+            this->Traverse([&](const Box &box) { return box.Overlaps(query); }, func);
+        }
+
+        template<typename Func>
+        void QueryPoint(const Vec2 &point, Func &&func) const {
+            this->Traverse([&](const Box &box) { return box.Contains(point.x, point.y); }, func);
+        }
+
+        template<typename Func>
+        void QueryRadius(const Vec2 &center, float radius, Func &&func) const {
+            this->Traverse([&](const Box &box) { return box.Distance2(center.x, center.y) <= radius * radius; }, func);
+        }
+
+        // Calls func(data, distance) for the boxes the ray crosses within `maxDistance`, in tree order.
+        // func returns the new maximum distance: its argument to keep the nearest hit only, 0 to stop
+        // or the current maximum to get them all. `direction` must be normalized
+        template<typename Func>
+        void Raycast(const Vec2 &origin, const Vec2 &direction, float maxDistance, Func &&func) const {
+            if (this->root == null) {
+                return;
+            }
+            auto stack = this->Stack();
+            stack.push_back(this->root);
+            while (!stack.empty() && maxDistance > 0) {
+                auto &node = this->nodes[stack.back()];
+                stack.pop_back();
+                auto &box = node.IsLeaf() ? node.tight : node.box;
+                float distance;
+                if (!box.Intersects(origin, direction, maxDistance, distance)) {
+                    continue;
+                }
+                if (node.IsLeaf()) {
+                    maxDistance = std::min(maxDistance, (float) func(node.data, distance));
+                } else {
+                    stack.push_back(node.left);
+                    stack.push_back(node.right);
+                }
+            }
+            this->Release(std::move(stack));
+        }
+
+    private:
+        struct Box {
+            float x0, y0, x1, y1;
+
+            float Perimeter() const { return 2 * (this->x1 - this->x0 + this->y1 - this->y0); }
+            bool Overlaps(const Box &o) const { return this->x0 < o.x1 && o.x0 < this->x1 && this->y0 < o.y1 && o.y0 < this->y1; }
+            bool Contains(float x, float y) const { return x >= this->x0 && x < this->x1 && y >= this->y0 && y < this->y1; }
+            bool Contains(const Box &o) const { return this->x0 <= o.x0 && this->y0 <= o.y0 && o.x1 <= this->x1 && o.y1 <= this->y1; }
+            float Distance2(float x, float y) const;
+            bool Intersects(const Vec2 &origin, const Vec2 &direction, float maxDistance, float &distance) const;
+            static Box Union(const Box &a, const Box &b);
+        };
+
+        // Free nodes are chained through `parent`
+        struct Node {
+            Box box;
+            Box tight;
+            int32_t parent = null;
+            int32_t left = null;
+            int32_t right = null;
+            int32_t height = 0;
+            uint32_t data = 0;
+
+            bool IsLeaf() const { return this->left == null; }
+        };
+
+        float margin;
+        std::vector<Node> nodes;
+        int32_t root = null;
+        int32_t freeList = null;
+        size_t leafCount = 0;
+        // Traversal stacks, reused so that queries do not allocate and may nest
+        mutable std::vector<std::vector<int32_t>> stacks;
+
+        int32_t AllocateNode();
+        void FreeNode(int32_t index);
+        void InsertLeaf(int32_t leaf);
+        void RemoveLeaf(int32_t leaf);
+        int32_t Balance(int32_t index);
+        void Refit(int32_t index);
+
+        std::vector<int32_t> Stack() const {
+            if (this->stacks.empty()) {
+                return {};
+            }
+            auto stack = std::move(this->stacks.back());
+            this->stacks.pop_back();
+            stack.clear();
+            return stack;
+        }
+
+        void Release(std::vector<int32_t> &&stack) const {
+            this->stacks.push_back(std::move(stack));
+        }
+
+        template<typename Test, typename Func>
+        void Traverse(Test &&test, Func &&func) const {
+            if (this->root == null) {
+                return;
+            }
+            auto stack = this->Stack();
+            stack.push_back(this->root);
+            bool running = true;
+            while (running && !stack.empty()) {
+                auto &node = this->nodes[stack.back()];
+                stack.pop_back();
+                if (!test(node.IsLeaf() ? node.tight : node.box)) {
+                    continue;
+                }
+                if (node.IsLeaf()) {
+                    running = func(node.data);
+                } else {
+                    stack.push_back(node.left);
+                    stack.push_back(node.right);
+                }
+            }
+            this->Release(std::move(stack));
+        }
+    };
+
+    enum class SimdLevel {
+        Scalar, SSE2, AVX
+    };
+
+    // Best level the running CPU supports, detected once
+    SimdLevel GetSimdLevel();
+    const char *GetSimdLevelName(SimdLevel level);
+
+    // Adds velocity * dt to every position with the step truncated to whole units, the same as
+    // `pos += velocity * dt` on Vec2. Each level gives bit-identical results, levels the CPU lacks
+    // fall back to the best one it has
+    void IntegrateMotion(float *x, float *y, const float *velocityX, const float *velocityY, size_t count, float dt, SimdLevel level = GetSimdLevel());
+
+    // Positions and velocities split into x and y arrays, so that IntegrateMotion loads them
+    // straight into vector registers
+    struct MotionArrays final {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> velocityX;
+        std::vector<float> velocityY;
+
+        size_t Size() const { return this->x.size(); }
+        void Resize(size_t count);
+        void Integrate(float dt, SimdLevel level = GetSimdLevel());
+    };
 
     enum class Direction {
         Up, Down, Left, Right
@@ -0,0 +1,279 @@
+#include "bench.h"
+#include "../lib/components.h"
+#include "../lib/physics.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+using namespace engine;
+using Clock = std::chrono::steady_clock;
+
+
+template<typename Func>
+static double MeasureMs(int rounds, Func &&func) {
+    func();
+    auto start = Clock::now();
+    for (int i = 0; i < rounds; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / rounds;
+}
+
+int sandbox::Benchmark::Run(int argc, char **argv) {
+    Benchmark::ParallelEach();
+    Benchmark::SpawnBatch();
+    Benchmark::Group();
+    Benchmark::BroadPhase();
+    Benchmark::Physics();
+    Benchmark::Integration();
+    return 0;
+}
+
+void sandbox::Benchmark::ParallelEach() {
+    using components::Movement;
+    const float dt = 1.0f / 60;
+
+    std::cout << std::format("ParallelEach<Movement> vs Each<Movement> ({} workers)", ThreadPool::DefaultWorkerCount()) << std::endl;
+    for (size_t count : { 10000, 100000, 1000000 }) {
+        ecs::World world;
+        ecs::Commands spawner(world);
+        for (size_t i = 0; i < count; i++) {
+            spawner.Spawn(Movement { Vec2((int) (i % 600) - 300, (int) (i % 400) - 200), Vec2((int) (i % 800), (int) (i % 600)) });
+        }
+        spawner.Execute();
+
+        ecs::Querier q(world);
+        auto serial = MeasureMs(20, [&]() {
+            q.Each<Movement>([&](Movement &m) {
+                m.pos += m.velocity * dt;
+            });
+        });
+        auto parallel = MeasureMs(20, [&]() {
+            ecs::Commands commands(world);
+            q.ParallelEach<Movement>(commands, [&](Movement &m) {
+                m.pos += m.velocity * dt;
+            });
+        });
+        ecs::ParallelOptions options;
+        options.deterministic = true;
+        auto deterministic = MeasureMs(20, [&]() {
+            ecs::Commands commands(world);
+            q.ParallelEach<Movement>(commands, [&](Movement &m) {
+                m.pos += m.velocity * dt;
+            }, options);
+        });
+
+        std::cout << std::format("  {:>8} entities: serial {:.3f} ms, parallel {:.3f} ms ({:.2f}x), deterministic {:.3f} ms ({:.2f}x)",
+            count, serial, parallel, serial / parallel, deterministic, serial / deterministic) << std::endl;
+        world.Shutdown();
+    }
+}
+
+void sandbox::Benchmark::SpawnBatch() {
+    using components::Movement;
+    using components::Graph;
+    const size_t count = 100000;
+    Movement movement { Vec2(1, 1), Vec2(0, 0) };
+    Graph graph;
+
+    std::cout << std::format("Spawning {} entities with Movement + Graph", count) << std::endl;
+    auto measure = [&](const char *name, auto &&record) {
+        auto ms = MeasureMs(5, [&]() {
+            ecs::World world;
+            ecs::Commands commands(world);
+            record(commands);
+            commands.Execute();
+            world.Shutdown();
+        });
+        std::cout << std::format("  {:>12}: {:.3f} ms", name, ms) << std::endl;
+    };
+
+    measure("Spawn", [&](ecs::Commands &commands) {
+        for (size_t i = 0; i < count; i++) {
+            commands.Spawn(movement, graph);
+        }
+    });
+    measure("SpawnBatch", [&](ecs::Commands &commands) {
+        commands.SpawnBatch(count, movement, graph);
+    });
+    ecs::Prefab prefab(movement, graph);
+    measure("Instantiate", [&](ecs::Commands &commands) {
+        commands.Instantiate(prefab, count);
+    });
+}
+
+void sandbox::Benchmark::Group() {
+    using components::Movement;
+    using components::Texture2D;
+    const size_t count = 100000;
+
+    // Every other entity has no texture, so the view has to skip entities
+    std::cout << std::format("Movement + Texture2D over {} entities, half of them textured", count) << std::endl;
+    ecs::World world;
+    ecs::Commands spawner(world);
+    spawner.SpawnBatch(count / 2, Movement { Vec2(1, 1), Vec2(0, 0) }, Texture2D {});
+    spawner.SpawnBatch(count / 2, Movement { Vec2(1, 1), Vec2(0, 0) });
+    spawner.Execute();
+
+    ecs::Querier q(world);
+    float sum = 0;
+    auto view = MeasureMs(20, [&]() {
+        q.Each<const Movement, const Texture2D>([&](const Movement &m, const Texture2D &t) {
+            sum += m.pos.x + t.renderPos.x;
+        });
+    });
+    auto group = MeasureMs(20, [&]() {
+        q.Group<const Movement, const Texture2D>().Each([&](const Movement &m, const Texture2D &t) {
+            sum += m.pos.x + t.renderPos.x;
+        });
+    });
+    std::cout << std::format("  view {:.3f} ms, group {:.3f} ms ({:.2f}x)", view, group, view / group) << std::endl;
+    world.Shutdown();
+}
+
+void sandbox::Benchmark::BroadPhase() {
+    const size_t count = 10000;
+    const Vec2 size(16, 16);
+    std::vector<Vec2> positions;
+    std::vector<Vec2> velocities;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> x(0, 1920), y(0, 1080), v(-2, 2);
+    for (size_t i = 0; i < count; i++) {
+        positions.emplace_back(x(rng), y(rng));
+        velocities.emplace_back(v(rng), v(rng));
+    }
+    auto step = [&]() {
+        for (size_t i = 0; i < count; i++) {
+            positions[i] += velocities[i];
+        }
+    };
+
+    std::cout << std::format("Overlapping pairs among {} moving 16x16 colliders over 1920x1080", count) << std::endl;
+    size_t bruteTests = 0, brutePairs = 0;
+    auto brute = MeasureMs(3, [&]() {
+        step();
+        bruteTests = brutePairs = 0;
+        for (size_t i = 0; i < count; i++) {
+            auto r1 = Vec2::CreateFRect(positions[i], size);
+            for (size_t j = i + 1; j < count; j++) {
+                auto r2 = Vec2::CreateFRect(positions[j], size);
+                SDL_FRect overlap;
+                bruteTests++;
+                brutePairs += SDL_IntersectFRect(&r1, &r2, &overlap);
+            }
+        }
+    });
+    SpatialHash grid(32);
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    auto hashed = MeasureMs(20, [&]() {
+        step();
+        grid.Clear();
+        for (auto &pos : positions) {
+            grid.Insert(pos, size);
+        }
+        grid.Pairs(pairs);
+    });
+    std::cout << std::format("  brute force {:.3f} ms ({} tests, {} pairs), spatial hash {:.3f} ms ({} pairs, {:.1f}x)",
+        brute, bruteTests, brutePairs, hashed, pairs.size(), brute / hashed) << std::endl;
+}
+
+void sandbox::Benchmark::Physics() {
+    using components::Movement;
+    using physics::RigidBody;
+    const size_t columns = 500, rows = 10;
+
+    // Separate columns of boxes on a static floor, each column an island of its own
+    std::cout << std::format("Physics step over {} stacked boxes, a dropped ball disturbing one column", columns * rows) << std::endl;
+    auto measure = [&](float timeToSleep) {
+        ecs::World world;
+        physics::PhysicsSettings settings;
+        settings.timeToSleep = timeToSleep;
+        physics::AddPhysics(world, settings);
+        auto &physics = ecs::Resources(world).Get<physics::PhysicsWorld>();
+        ecs::Commands spawner(world);
+        spawner.Spawn(Movement { Vec2(), Vec2(0, 1000) }, RigidBody { physics::Shape::Box, Vec2(columns * 50, 40), Vec2(), Vec2(), 0 });
+        for (size_t column = 0; column < columns; column++) {
+            for (size_t row = 0; row < rows; row++) {
+                spawner.Spawn(Movement { Vec2(), Vec2(column * 50, 960 - row * 41) }, RigidBody { physics::Shape::Box, Vec2(40, 40) });
+            }
+        }
+        spawner.Execute();
+        auto step = [&]() {
+            ecs::Querier q(world);
+            physics.Step(q, 1.0f / 60);
+        };
+        for (int i = 0; i < 120; i++) {
+            step();
+        }
+        ecs::Commands dropper(world);
+        dropper.Spawn(Movement { Vec2(), Vec2(5, 500) }, RigidBody { physics::Shape::Circle, Vec2(30, 30) });
+        dropper.Execute();
+        auto ms = MeasureMs(60, step);
+        auto awake = physics.GetAwakeCount();
+        world.Shutdown();
+        return std::make_pair(ms, awake);
+    };
+    auto [awakeMs, awakeCount] = measure(std::numeric_limits<float>::max());
+    auto [sleepingMs, sleepingCount] = measure(0.5f);
+    std::cout << std::format("  never sleeping {:.3f} ms ({} awake), sleeping islands {:.3f} ms ({} awake, {:.1f}x)",
+        awakeMs, awakeCount, sleepingMs, sleepingCount, awakeMs / sleepingMs) << std::endl;
+}
+
+void sandbox::Benchmark::Integration() {
+    using components::Movement;
+    const size_t count = 1000000;
+    const float dt = 1.0f / 60;
+
+    std::cout << std::format("Integrating {} positions, Movement components against x/y arrays", count) << std::endl;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> position(-1000, 1000), velocity(-600, 600);
+    ecs::World world;
+    ecs::Commands spawner(world);
+    MotionArrays arrays;
+    arrays.Resize(count);
+    for (size_t i = 0; i < count; i++) {
+        Movement movement { Vec2(velocity(rng), velocity(rng)), Vec2(position(rng), position(rng)) };
+        arrays.x[i] = movement.pos.x;
+        arrays.y[i] = movement.pos.y;
+        arrays.velocityX[i] = movement.velocity.x;
+        arrays.velocityY[i] = movement.velocity.y;
+        spawner.Spawn(movement);
+    }
+    spawner.Execute();
+
+    ecs::Querier q(world);
+    const int rounds = 20;
+    auto components = MeasureMs(rounds, [&]() {
+        q.Each<Movement>([&](Movement &m) {
+            m.prevPos = m.pos;
+            m.pos += m.velocity * dt;
+        });
+    });
+    auto perSecond = [&](double ms) {
+        return count / ms / 1000;
+    };
+    std::cout << std::format("  Each<Movement> {:.3f} ms ({:.0f} M/s)", components, perSecond(components)) << std::endl;
+
+    // Every level starts from the same arrays and has to land on the positions the components reached
+    std::vector<float> x, y;
+    for (auto level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX }) {
+        if (level > GetSimdLevel()) {
+            continue;
+        }
+        x = arrays.x;
+        y = arrays.y;
+        auto ms = MeasureMs(rounds, [&]() {
+            IntegrateMotion(x.data(), y.data(), arrays.velocityX.data(), arrays.velocityY.data(), count, dt, level);
+        });
+        size_t i = 0;
+        bool identical = true;
+        q.Each<const Movement>([&](const Movement &m) {
+            identical &= std::memcmp(&m.pos.x, &x[i], sizeof(float)) == 0 && std::memcmp(&m.pos.y, &y[i], sizeof(float)) == 0;
+            i++;
+        });
+        std::cout << std::format("  {} arrays {:.3f} ms ({:.0f} M/s, {:.2f}x), {}", GetSimdLevelName(level), ms, perSecond(ms),
+            components / ms, identical ? "identical" : "MISMATCH") << std::endl;
+    }
+    world.Shutdown();
+}
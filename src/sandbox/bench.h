@@ -0,0 +1,18 @@
+#pragma once
+#include "../lib/ecs.h"
+
+namespace sandbox {
+    // Headless micro benchmarks, run with `chemwar --bench`
+    class Benchmark final {
+    public:
+        static int Run(int argc, char **argv);
+
+    private:
+        static void ParallelEach();
+        static void SpawnBatch();
+        static void Group();
+        static void BroadPhase();
+        static void Physics();
+        static void Integration();
+    };
+}
@@ -4,15 +4,31 @@
 
 using namespace engine;
 
+ecs::World sandbox::Game::world;
 
 void sandbox::Game::Prepare(int argc, char **argv) {
     preset::BeginGUIContext(argc, argv, 800, 600, "Engine");
     Renderer::LoadFont("assets/genshin-font.ttf", 32);
     Renderer::SetGlobalBackGround("assets/bg.png");
+
+    // The world updates at a fixed rate and renders every frame in between, interpolated
+    world.SetFixedTimestep(1.0f / MAX_FRAMERATE);
+    components::InitResources(world);
+    world.AddSystem(components::SceneIndexSystem, "scene index");
+    world.AddSystem(components::MovementSystem, components::MovementSystemAccess(), "movement");
+    world.AddSystem(components::SimpleCollider2DSystem, "collision");
+    world.AddSystem(components::SimpleTimerSystem, "timer");
+    world.AddRenderSystem(components::Texture2DRenderSystem, "texture");
+    world.AddRenderSystem(components::BasicGraphRenderSystem, "basic graph");
+    world.AddRenderSystem(components::GraphRenderSystem, "graph");
+    world.AddRenderSystem(components::BasicTextRenderSystem, "text");
+    world.AddRenderSystem(components::LabelTextRenderSystem, "label");
+    world.Startup();
 }
 
 void sandbox::Game::Run() {
-    preset::SetGUIProc([=](float) {
+    preset::SetGUIProc([=](float dt) {
+        world.Advance(dt);
         preset::Begin(Vec2(100, 100), Vec2(300, 300), "Hello, my IMGUI", 0);
         preset::Begin(Vec2(320, 160), Vec2(320, 160), "SubWindow", 0);
         preset::Begin(Vec2(400, 100), Vec2(128, 64), "SubWindow2", 0);
@@ -29,5 +45,7 @@ void sandbox::Game::Run() {
 } 
 
 void sandbox::Game::Quit() {
+    // Render resources hold textures, they go before the renderer
+    world.Shutdown();
     preset::EndGUIContext();
 }
@@ -10,5 +10,8 @@ namespace sandbox {
         static void Prepare(int argc, char **argv);
         static void Run();
         static void Quit();
+
+    private:
+        static ecs::World world;
     };
 }
@@ -1,8 +1,12 @@
 #include "game.h"
+#include "bench.h"
 #include "../lib/plugins/profiler.hpp"
 
 
 int main(int argc, char *argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        return sandbox::Benchmark::Run(argc, argv);
+    }
     sandbox::Game::Prepare(argc, argv);
     // Renderer::EnableProfiling("engine_profile.dat");
     Renderer::EnableFPSCounter();
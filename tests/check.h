@@ -0,0 +1,22 @@
+#pragma once
+#include <iostream>
+
+// Failed checks are counted instead of aborting, so that one run lists every broken expectation
+namespace tests {
+    inline int failures = 0;
+
+    inline int Report() {
+        if (failures != 0) {
+            std::cerr << failures << " check(s) failed\n";
+        }
+        return failures != 0;
+    }
+}
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            tests::failures++; \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+        } \
+    } while (0)
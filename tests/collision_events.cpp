@@ -0,0 +1,74 @@
+#include "check.h"
+#include "lib/components.h"
+
+using namespace engine;
+using namespace engine::components;
+
+namespace {
+    // What Listen read each frame, which is what SimpleCollider2DSystem wrote the frame before
+    std::vector<std::vector<CollisionEvent>> heard;
+
+    void Listen(ecs::Commands &commander, ecs::Querier q, ecs::Resources r, ecs::Events &e) {
+        auto events = e.Reader<CollisionEvent>().Read();
+        heard.emplace_back(events.begin(), events.end());
+    }
+
+    bool Is(const CollisionEvent &event, ecs::Entity a, ecs::Entity b, CollisionPhase phase) {
+        return event.a == a && event.b == b && event.phase == phase;
+    }
+
+    void MoveTo(ecs::World &world, ecs::Entity entity, Vec2 pos) {
+        ecs::Querier(world).Get<Movement>(entity).pos = pos;
+    }
+}
+
+int main() {
+    ecs::World world;
+    InitResources(world);
+    world.AddSystem(SimpleCollider2DSystem).AddSystem(Listen);
+    int calls = 0;
+    ecs::Commands commands(world);
+    auto a = commands.Spawned(Movement { Vec2(), Vec2(0, 0) }, SimpleCollider2D { "a", false, Vec2(10, 10) });
+    auto b = commands.Spawned(Movement { Vec2(), Vec2(5, 5) }, SimpleCollider2D { "b", false, Vec2(10, 10),
+        [&](const std::string &tag, ecs::Entity self, const std::string &other, ecs::Entity) {
+            calls++;
+            CHECK(tag == "b");
+            CHECK(other == "a");
+        }
+    });
+    auto c = commands.Spawned(Movement { Vec2(), Vec2(500, 500) }, SimpleCollider2D { "c", false, Vec2(10, 10) });
+    commands.Execute();
+
+    auto &events = ecs::Resources(world).Get<CollisionBroadPhase>().events;
+    world.Update();
+    CHECK(events.size() == 1 && Is(events[0], a, b, CollisionPhase::Begin));
+    CHECK(events[0].tagA == CollisionTag("a") && events[0].tagB == CollisionTag("b"));
+    // The deprecated callback still runs during the frame, from its own side
+    CHECK(calls == 1);
+
+    MoveTo(world, c, Vec2(-5, -5));
+    world.Update();
+    CHECK(events.size() == 2 && Is(events[0], a, b, CollisionPhase::Stay) && Is(events[1], a, c, CollisionPhase::Begin));
+
+    MoveTo(world, b, Vec2(100, 100));
+    world.Update();
+    CHECK(events.size() == 2 && Is(events[0], a, b, CollisionPhase::End) && Is(events[1], a, c, CollisionPhase::Stay));
+    CHECK(calls == 2);
+
+    // Destroyed colliders end their contacts as well
+    ecs::Commands destroy(world);
+    destroy.Destroy(c);
+    destroy.Execute();
+    world.Update();
+    CHECK(events.size() == 1 && Is(events[0], a, c, CollisionPhase::End));
+    world.Update();
+    CHECK(events.empty());
+
+    // Readers get each frame's events on the next one
+    CHECK(heard.size() == 5);
+    CHECK(heard[0].empty());
+    CHECK(heard[1].size() == 1 && Is(heard[1][0], a, b, CollisionPhase::Begin));
+    CHECK(heard[4].size() == 1 && Is(heard[4][0], a, c, CollisionPhase::End));
+    world.Shutdown();
+    return tests::Report();
+}
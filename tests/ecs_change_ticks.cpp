@@ -0,0 +1,84 @@
+#include "check.h"
+#include "lib/ecs.h"
+
+using namespace engine::ecs;
+
+namespace {
+    struct Position {
+        int x;
+    };
+
+    struct Velocity {
+        int v;
+    };
+
+    struct Score {
+        int value;
+    };
+
+    int frame = 0;
+    Entity special = EntityTraits::null;
+    // Per frame, what Watch saw
+    std::vector<int> addedScores, changedPositions, changedScores;
+
+    void Spawn(Commands &commander, Querier q, Resources r, Events &e) {
+        if (frame == 0) {
+            for (int i = 0; i < 100; i++) {
+                auto entity = commander.Spawned(Position { i }, Velocity { 1 }, Score { 0 });
+                if (i == 7) {
+                    special = entity;
+                }
+            }
+        }
+        if (frame == 3) {
+            commander.Spawn(Position { 1000 }, Score { 0 });
+        }
+    }
+
+    void Touch(Commands &commander, Querier q, Resources r, Events &e) {
+        if (frame == 2) {
+            q.Each<Position, const Velocity>([](Position &pos, const Velocity &vel) {
+                pos.x += vel.v;
+            });
+        }
+        if (frame == 5) {
+            q.Get<Score>(special).value = 5;
+        }
+        // Read-only access leaves the ticks alone
+        if (frame == 6) {
+            q.Get<const Score>(special);
+            q.Each<const Position>([](const Position &) {});
+        }
+        if (frame == 7) {
+            q.ForEachChunk<Position>([](ChunkView chunk) {
+                chunk.Column<Position>();
+            });
+        }
+    }
+
+    void Watch(Commands &commander, Querier q, Resources r, Events &e) {
+        int added = 0, positions = 0, scores = 0;
+        q.View<const Score>().Added<Score>().Each([&](const Score &) { added++; });
+        q.View<const Position>().Changed<Position>().Each([&](const Position &) { positions++; });
+        q.View<const Score>().Changed<Score>().Each([&](const Score &) { scores++; });
+        addedScores.push_back(added);
+        changedPositions.push_back(positions);
+        changedScores.push_back(scores);
+    }
+}
+
+int main() {
+    World world;
+    world.AddSystem(Spawn).AddSystem(Touch).AddSystem(Watch);
+    for (frame = 0; frame < 9; frame++) {
+        world.Update();
+    }
+
+    // Spawns show up the frame after their commands ran, as both added and changed
+    CHECK(addedScores == std::vector<int>({ 0, 100, 0, 0, 1, 0, 0, 0, 0 }));
+    CHECK(changedScores == std::vector<int>({ 0, 100, 0, 0, 1, 1, 0, 0, 0 }));
+    // Systems earlier in the frame are seen the same frame, mutable chunk columns mark every row
+    CHECK(changedPositions == std::vector<int>({ 0, 100, 100, 0, 1, 0, 0, 101, 0 }));
+    world.Shutdown();
+    return tests::Report();
+}
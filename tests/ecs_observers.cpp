@@ -0,0 +1,94 @@
+#include "check.h"
+#include "lib/ecs.h"
+
+using namespace engine::ecs;
+
+namespace {
+    struct Position {
+        int x;
+    };
+
+    struct Velocity {
+        int v;
+    };
+
+    struct Marked {};
+}
+
+int main() {
+    World world;
+    int added = 0, addCalls = 0, removed = 0, removedSum = 0, replaced = 0, velocityRemoved = 0, marked = 0, unmarked = 0;
+    world.OnAdd<Position>([&](World &, std::span<const Entity> entities) {
+        added += entities.size();
+        addCalls++;
+    });
+    // Removed components are still readable while their observers run
+    world.OnRemove<Position>([&](World &w, std::span<const Entity> entities) {
+        Querier q(w);
+        removed += entities.size();
+        for (auto entity : entities) {
+            removedSum += q.Get<const Position>(entity).x;
+        }
+    });
+    world.OnReplace<Position>([&](World &, std::span<const Entity> entities) {
+        replaced += entities.size();
+    });
+    world.OnRemove<Velocity>([&](World &, std::span<const Entity> entities) {
+        velocityRemoved += entities.size();
+    });
+    world.OnAdd<Marked>([&](World &, std::span<const Entity> entities) {
+        marked += entities.size();
+    });
+    world.OnRemove<Marked>([&](World &, std::span<const Entity> entities) {
+        unmarked += entities.size();
+    });
+
+    // One batch per component and Execute, however the entities were spawned
+    Commands spawn(world);
+    auto entities = spawn.SpawnedBatch(100, Position { 1 }, Velocity { 1 });
+    for (int i = 0; i < 50; i++) {
+        spawn.Spawn(Position { 2 });
+    }
+    spawn.Execute();
+    CHECK(added == 150);
+    CHECK(addCalls == 1);
+
+    Commands change(world);
+    // Destroying twice notifies once
+    for (int i = 0; i < 10; i++) {
+        change.Destroy(entities[i]);
+        change.Destroy(entities[i]);
+    }
+    for (int i = 10; i < 20; i++) {
+        change.Remove<Position>(entities[i]);
+    }
+    for (int i = 20; i < 30; i++) {
+        change.Insert(entities[i], Position { 5 });
+    }
+    for (int i = 30; i < 40; i++) {
+        change.Insert(entities[i], Marked {});
+    }
+    change.Execute();
+    CHECK(removed == 20);
+    CHECK(removedSum == 20);
+    CHECK(velocityRemoved == 10);
+    CHECK(replaced == 10);
+    CHECK(marked == 10);
+    CHECK(added == 150);
+
+    Commands again(world);
+    for (int i = 30; i < 35; i++) {
+        again.Remove<Marked>(entities[i]);
+    }
+    for (int i = 10; i < 15; i++) {
+        again.Insert(entities[i], Position { 9 });
+    }
+    again.Execute();
+    CHECK(unmarked == 5);
+    CHECK(added == 155);
+    CHECK(addCalls == 2);
+    CHECK(replaced == 10);
+
+    world.Shutdown();
+    return tests::Report();
+}
@@ -0,0 +1,126 @@
+#include "check.h"
+#include "lib/ecs.h"
+#include <string>
+
+using namespace engine::ecs;
+
+namespace {
+    struct Position {
+        float x;
+    };
+
+    struct Name {
+        std::string value;
+    };
+
+    // Rebuilt by whoever needs it, so snapshots leave it out
+    struct Cache {
+        std::string text = "empty";
+    };
+
+    struct Counter {
+        int value;
+    };
+
+    void WriteName(const Name &name, std::vector<std::byte> &out) {
+        uint32_t length = name.value.size();
+        auto at = out.size();
+        out.resize(at + sizeof(length) + length);
+        std::memcpy(out.data() + at, &length, sizeof(length));
+        std::memcpy(out.data() + at + sizeof(length), name.value.data(), length);
+    }
+
+    Name ReadName(std::span<const std::byte> block, size_t &cursor) {
+        uint32_t length;
+        std::memcpy(&length, block.data() + cursor, sizeof(length));
+        Name name { std::string((const char *) block.data() + cursor + sizeof(length), length) };
+        cursor += sizeof(length) + length;
+        return name;
+    }
+
+    void CaptureRestore() {
+        World world;
+        world.Persist<Name>("name", WriteName, ReadName);
+        world.Transient<Cache>();
+        world.SetResource(Counter { 1 });
+        Commands commands(world);
+        std::vector<Entity> entities;
+        for (int i = 0; i < 500; i++) {
+            entities.push_back(commands.Spawned(Position { (float) i }, Name { "entity " + std::to_string(i) }, Cache { "built" }));
+        }
+        commands.Execute();
+
+        std::vector<std::byte> snapshot;
+        world.Capture(snapshot);
+
+        Querier q(world);
+        q.Each<Position, Name>([](Position &pos, Name &name) {
+            pos.x = -1;
+            name.value = "changed";
+        });
+        Commands change(world);
+        for (int i = 0; i < 500; i += 2) {
+            change.Destroy(entities[i]);
+        }
+        auto spawned = change.Spawned(Position { 5 }, Name { "new" });
+        change.Execute();
+        Resources(world).Get<Counter>().value = 2;
+
+        world.Restore(snapshot);
+        Querier restored(world);
+        CHECK(!restored.IsAlive(spawned));
+        int names = 0;
+        restored.Each<const Name>([&](const Name &) { names++; });
+        CHECK(names == 500);
+        for (int i = 0; i < 500; i++) {
+            CHECK(restored.IsAlive(entities[i]));
+            CHECK(restored.Get<const Position>(entities[i]).x == i);
+            CHECK(restored.Get<const Name>(entities[i]).value == "entity " + std::to_string(i));
+            CHECK(restored.Get<const Cache>(entities[i]).text == "empty");
+        }
+        CHECK(Resources(world).Get<Counter>().value == 1);
+        world.Shutdown();
+    }
+
+    // Every age reconstructs the world as it was when that snapshot was pushed
+    void Ring() {
+        World world;
+        world.Persist<Name>("name", WriteName, ReadName);
+        SnapshotRing ring(3);
+        std::vector<Entity> entities;
+        for (int step = 0; step < 5; step++) {
+            Commands commands(world);
+            entities.push_back(commands.Spawned(Position { (float) step }, Name { std::to_string(step) }));
+            commands.Execute();
+            ring.Push(world);
+        }
+        CHECK(ring.Size() == 3);
+
+        // Age n holds the entities spawned up to step 4 - n
+        for (size_t age : { 2, 0, 1 }) {
+            ring.Restore(world, age);
+            Querier q(world);
+            for (size_t step = 0; step < 5; step++) {
+                auto alive = step + age <= 4;
+                CHECK(q.IsAlive(entities[step]) == alive);
+                if (alive) {
+                    CHECK(q.Get<const Name>(entities[step]).value == std::to_string(step));
+                }
+            }
+        }
+
+        ring.Restore(world, 1);
+        ring.Rewind(1);
+        CHECK(ring.Size() == 2);
+        ring.Restore(world, 0);
+        CHECK(!Querier(world).IsAlive(entities[4]));
+        CHECK(Querier(world).IsAlive(entities[3]));
+        world.Shutdown();
+    }
+}
+
+int main() {
+    CaptureRestore();
+    Ring();
+    return tests::Report();
+}
@@ -0,0 +1,131 @@
+#include "check.h"
+#include "lib/ecs.h"
+#include <string>
+
+using namespace engine::ecs;
+
+namespace {
+    struct Position {
+        int x;
+    };
+
+    struct Name {
+        std::string value;
+    };
+
+    struct Frozen {};
+
+    // Destroying rows swaps the last one of the chunk into the hole, which has to carry its
+    // components and its entity record along
+    void SwapRemove() {
+        World world;
+        Commands commands(world);
+        std::vector<Entity> entities;
+        for (int i = 0; i < 1000; i++) {
+            entities.push_back(commands.Spawned(Position { i }, Name { "entity " + std::to_string(i) }));
+        }
+        commands.Execute();
+
+        Commands destroy(world);
+        for (int i = 0; i < 1000; i += 3) {
+            destroy.Destroy(entities[i]);
+        }
+        destroy.Execute();
+
+        Querier q(world);
+        int alive = 0;
+        for (int i = 0; i < 1000; i++) {
+            if (i % 3 == 0) {
+                CHECK(!q.IsAlive(entities[i]));
+                continue;
+            }
+            alive++;
+            CHECK(q.Get<const Position>(entities[i]).x == i);
+            CHECK(q.Get<const Name>(entities[i]).value == "entity " + std::to_string(i));
+        }
+        int visited = 0;
+        q.Each<const Position, const Name>([&](Entity entity, const Position &pos, const Name &name) {
+            visited++;
+            CHECK(entities[pos.x] == entity);
+            CHECK(name.value == "entity " + std::to_string(pos.x));
+        });
+        CHECK(visited == alive);
+        world.Shutdown();
+    }
+
+    // Inserting and removing components moves entities between archetypes, non-trivial values included
+    void Relocation() {
+        World world;
+        Commands commands(world);
+        std::vector<Entity> entities;
+        for (int i = 0; i < 200; i++) {
+            entities.push_back(commands.Spawned(Position { i }, Name { std::string(64, 'a' + i % 26) }));
+        }
+        commands.Execute();
+
+        Commands move(world);
+        for (int i = 0; i < 200; i += 2) {
+            move.Insert(entities[i], Frozen {});
+        }
+        for (int i = 1; i < 200; i += 4) {
+            move.Remove<Position>(entities[i]);
+        }
+        move.Execute();
+
+        Querier q(world);
+        for (int i = 0; i < 200; i++) {
+            auto entity = entities[i];
+            CHECK(q.Has<Frozen>(entity) == (i % 2 == 0));
+            CHECK(q.Has<Position>(entity) == (i % 4 != 1));
+            if (q.Has<Position>(entity)) {
+                CHECK(q.Get<const Position>(entity).x == i);
+            }
+            CHECK(q.Get<const Name>(entity).value == std::string(64, 'a' + i % 26));
+        }
+        int frozen = 0;
+        q.View<const Position>().With<Frozen>().Each([&](const Position &pos) {
+            frozen++;
+            CHECK(pos.x % 2 == 0);
+        });
+        CHECK(frozen == 100);
+        world.Shutdown();
+    }
+
+    // Recycled slots get a new version, so handles to destroyed entities stay dead
+    void GenerationalHandles() {
+        World world;
+        Commands commands(world);
+        auto first = commands.Spawned(Position { 1 });
+        commands.Execute();
+
+        Commands destroy(world);
+        destroy.Destroy(first);
+        destroy.Execute();
+
+        Commands respawn(world);
+        auto second = respawn.Spawned(Position { 2 });
+        respawn.Execute();
+
+        Querier q(world);
+        CHECK(EntityTraits::ToIndex(first) == EntityTraits::ToIndex(second));
+        CHECK(EntityTraits::ToVersion(first) != EntityTraits::ToVersion(second));
+        CHECK(!q.IsAlive(first));
+        CHECK(!q.Has<Position>(first));
+        CHECK(q.IsAlive(second));
+        CHECK(q.Get<const Position>(second).x == 2);
+
+        // Destroying through a stale handle leaves the new owner of the slot alone
+        Commands stale(world);
+        stale.Destroy(first);
+        stale.Execute();
+        CHECK(q.IsAlive(second));
+        world.Shutdown();
+    }
+}
+
+int main() {
+    SwapRemove();
+    Relocation();
+    GenerationalHandles();
+    return tests::Report();
+}
@@ -0,0 +1,134 @@
+#include "check.h"
+#include "lib/ecs.h"
+#include <filesystem>
+#include <string>
+
+using namespace engine::ecs;
+
+namespace {
+    struct Position {
+        float x;
+        float y;
+    };
+
+    struct Name {
+        std::string value;
+    };
+
+    struct Frozen {};
+
+    void WriteName(const Name &name, std::vector<std::byte> &out) {
+        uint32_t length = name.value.size();
+        auto at = out.size();
+        out.resize(at + sizeof(length) + length);
+        std::memcpy(out.data() + at, &length, sizeof(length));
+        std::memcpy(out.data() + at + sizeof(length), name.value.data(), length);
+    }
+
+    // Bounds-checked like any codec has to be, Load hands it the block as saved
+    Name ReadName(std::span<const std::byte> block, size_t &cursor) {
+        uint32_t length = 0;
+        if (block.size() - cursor >= sizeof(length)) {
+            std::memcpy(&length, block.data() + cursor, sizeof(length));
+            cursor += sizeof(length);
+        }
+        length = std::min<size_t>(length, block.size() - cursor);
+        Name name { std::string((const char *) block.data() + cursor, length) };
+        cursor += length;
+        return name;
+    }
+
+    void Register(World &world) {
+        world.Persist<Position>("position");
+        world.Persist<Name>("name", WriteName, ReadName);
+        world.Persist<Frozen>("frozen");
+    }
+
+    std::vector<char> ReadFile(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void WriteFile(const std::string &path, const char *data, size_t size) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(data, size);
+    }
+}
+
+int main() {
+    auto path = (std::filesystem::temp_directory_path() / "chemwar_world_file_test.bin").string();
+    auto broken = (std::filesystem::temp_directory_path() / "chemwar_world_file_test_broken.bin").string();
+    std::vector<Entity> entities;
+    {
+        World world;
+        Register(world);
+        Commands commands(world);
+        for (int i = 0; i < 40; i++) {
+            auto entity = commands.Spawned(Position { (float) i, (float) -i }, Name { std::string(i, 'n') });
+            if (i % 4 == 0) {
+                commands.Insert(entity, Frozen {});
+            }
+            entities.push_back(entity);
+        }
+        commands.Execute();
+        // Leaves a free slot, and a recycled one with a newer version
+        Commands destroy(world);
+        destroy.Destroy(entities[3]);
+        destroy.Destroy(entities[5]);
+        destroy.Execute();
+        Commands respawn(world);
+        entities[5] = respawn.Spawned(Position { 5, -5 }, Name { "respawned" });
+        respawn.Execute();
+        CHECK(world.Save(path));
+        world.Shutdown();
+    }
+
+    {
+        World world;
+        Register(world);
+        CHECK(world.Load(path));
+        Querier q(world);
+        for (int i = 0; i < 40; i++) {
+            if (i == 3) {
+                CHECK(!q.IsAlive(entities[i]));
+                continue;
+            }
+            CHECK(q.IsAlive(entities[i]));
+            CHECK(q.Get<const Position>(entities[i]).x == i);
+            CHECK(q.Get<const Name>(entities[i]).value == (i == 5 ? "respawned" : std::string(i, 'n')));
+            CHECK(q.Has<Frozen>(entities[i]) == (i % 4 == 0 && i != 5));
+        }
+        // Loaded handles keep their slots, new spawns take the freed one
+        Commands commands(world);
+        auto spawned = commands.Spawned(Position {});
+        commands.Execute();
+        CHECK(EntityTraits::ToIndex(spawned) == EntityTraits::ToIndex(entities[3]));
+        CHECK(spawned != entities[3]);
+        world.Shutdown();
+    }
+
+    // Every truncation is rejected and leaves the world empty
+    auto bytes = ReadFile(path);
+    CHECK(!bytes.empty());
+    for (size_t length = 0; length < bytes.size(); length++) {
+        WriteFile(broken, bytes.data(), length);
+        World world;
+        Register(world);
+        CHECK(!world.Load(broken));
+        CHECK(!Querier(world).IsAlive(entities[0]));
+        world.Shutdown();
+    }
+
+    // So are files with a type this world does not know
+    {
+        World world;
+        world.Persist<Position>("position");
+        world.Persist<Name>("name", WriteName, ReadName);
+        CHECK(!world.Load(path));
+        world.Shutdown();
+    }
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(broken);
+    return tests::Report();
+}
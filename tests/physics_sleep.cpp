@@ -0,0 +1,85 @@
+#include "check.h"
+#include "lib/physics.h"
+
+using namespace engine;
+using namespace engine::physics;
+using components::Movement;
+
+namespace {
+    constexpr float dt = 1.0f / 60;
+
+    void Run(ecs::World &world, int steps) {
+        auto &physics = ecs::Resources(world).Get<PhysicsWorld>();
+        for (int i = 0; i < steps; i++) {
+            ecs::Querier q(world);
+            physics.Step(q, dt);
+        }
+    }
+}
+
+int main() {
+    ecs::World world;
+    AddPhysics(world);
+    auto &physics = ecs::Resources(world).Get<PhysicsWorld>();
+    ecs::Commands commands(world);
+    auto floor = commands.Spawned(Movement { Vec2(), Vec2(0, 600) }, RigidBody { Shape::Box, Vec2(2000, 40), Vec2(), Vec2(), 0 });
+    auto bottom = commands.Spawned(Movement { Vec2(), Vec2(100, 560) }, RigidBody { Shape::Box, Vec2(40, 40) });
+    auto top = commands.Spawned(Movement { Vec2(), Vec2(100, 519) }, RigidBody { Shape::Box, Vec2(40, 40) });
+    commands.Execute();
+
+    // A settled stack sleeps, static bodies never count as awake
+    Run(world, 120);
+    CHECK(physics.GetAwakeCount() == 0);
+    CHECK(physics.GetRestingCount() == 3);
+    CHECK(!physics.IsAwake(floor));
+    CHECK(!physics.IsAwake(bottom) && !physics.IsAwake(top));
+    auto rested = ecs::Querier(world).Get<const Movement>(top).pos;
+
+    // A body coming to rest close to the island without touching it leaves it asleep
+    ecs::Commands near(world);
+    auto neighbour = near.Spawned(Movement { Vec2(), Vec2(144, 560) }, RigidBody { Shape::Box, Vec2(40, 40) });
+    near.Execute();
+    Run(world, 5);
+    CHECK(physics.IsAwake(neighbour));
+    CHECK(!physics.IsAwake(bottom) && !physics.IsAwake(top));
+    Run(world, 120);
+    CHECK(physics.GetAwakeCount() == 0);
+
+    // Landing on the stack wakes the whole island, which goes back to sleep once it settles
+    ecs::Commands drop(world);
+    auto ball = drop.Spawned(Movement { Vec2(), Vec2(105, 300) }, RigidBody { Shape::Circle, Vec2(30, 30) });
+    drop.Execute();
+    bool woken = false;
+    for (int i = 0; i < 60 && !woken; i++) {
+        Run(world, 1);
+        woken = physics.IsAwake(top) && physics.IsAwake(bottom);
+    }
+    CHECK(woken);
+    CHECK(physics.IsAwake(ball));
+    Run(world, 300);
+    CHECK(physics.GetAwakeCount() == 0);
+    auto settled = ecs::Querier(world).Get<const Movement>(top).pos;
+    CHECK(std::abs(settled.y - rested.y) < 2);
+
+    // Without the floor, everything that rested on it wakes and falls
+    ecs::Commands remove(world);
+    remove.Destroy(floor);
+    remove.Execute();
+    CHECK(physics.IsAwake(bottom) && physics.IsAwake(top) && physics.IsAwake(ball) && physics.IsAwake(neighbour));
+    Run(world, 30);
+    CHECK(ecs::Querier(world).Get<const Movement>(bottom).pos.y > 600);
+
+    // Bodies that lose their Movement leave the simulation until they get one back
+    ecs::Commands strip(world);
+    strip.Remove<Movement>(top);
+    strip.Execute();
+    Run(world, 2);
+    CHECK(!physics.IsAwake(top));
+    ecs::Commands restore(world);
+    restore.Insert(top, Movement { Vec2(), Vec2(300, 0) });
+    restore.Execute();
+    Run(world, 2);
+    CHECK(physics.IsAwake(top));
+    world.Shutdown();
+    return tests::Report();
+}